@@ -489,4 +489,55 @@ int m_ld2string(char *buf, size_t len, long double value, int humanfriendly) {
     }
     buf[l] = '\0';
     return l;
-}
\ No newline at end of file
+}
+
+/* MurmurHash2, 64 bit version, by Austin Appleby. It was modified for
+ * endian neutrality, so that the same input produces the same hash on
+ * every platform. */
+uint64_t m_murmurhash64a(const void *key, int len, unsigned int seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const uint8_t *data = (const uint8_t *)key;
+    const uint8_t *end = data + (len - (len & 7));
+
+    while (data != end) {
+        uint64_t k;
+
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+        memcpy(&k, data, sizeof(uint64_t));
+#else
+        k = (uint64_t)data[0];
+        k |= (uint64_t)data[1] << 8;
+        k |= (uint64_t)data[2] << 16;
+        k |= (uint64_t)data[3] << 24;
+        k |= (uint64_t)data[4] << 32;
+        k |= (uint64_t)data[5] << 40;
+        k |= (uint64_t)data[6] << 48;
+        k |= (uint64_t)data[7] << 56;
+#endif
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+        data += 8;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= (uint64_t)data[6] << 48; /* fall-thru */
+    case 6: h ^= (uint64_t)data[5] << 40; /* fall-thru */
+    case 5: h ^= (uint64_t)data[4] << 32; /* fall-thru */
+    case 4: h ^= (uint64_t)data[3] << 24; /* fall-thru */
+    case 3: h ^= (uint64_t)data[2] << 16; /* fall-thru */
+    case 2: h ^= (uint64_t)data[1] << 8; /* fall-thru */
+    case 1: h ^= (uint64_t)data[0];
+            h *= m; /* fall-thru */
+    };
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
@@ -50,5 +50,6 @@ int m_string2l(const char *s, size_t slen, long *value);
 int m_string2ld(const char *s, size_t slen, long double *dp);
 int m_d2string(char *buf, size_t len, double value);
 int m_ld2string(char *buf, size_t len, long double value, int humanfriendly);
+uint64_t m_murmurhash64a(const void *key, int len, unsigned int seed);
 
 #endif
\ No newline at end of file
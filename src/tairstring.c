@@ -19,14 +19,18 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
+/* Blocking and keyspace notification APIs are still experimental. */
+#define REDISMODULE_EXPERIMENTAL_API
 #include "redismodule.h"
 #include "util.h"
 
@@ -44,22 +48,206 @@
 #define TAIR_STRING_SET_NONEGATIVE (1 << 10)
 #define TAIR_STRING_RETURN_WITH_VER (1 << 11)
 #define TAIR_STRING_SET_KEEPTTL (1 << 12)
+#define TAIR_STRING_SET_WITH_GT_VER (1 << 13)
+#define TAIR_STRING_SET_WITH_REQID (1 << 14)
+#define TAIR_STRING_SET_WITH_RESERVE (1 << 15)
+#define TAIR_STRING_SET_WITH_HALFLIFE (1 << 16)
+#define TAIR_STRING_SET_WITH_LEASE (1 << 17)
+#define TAIR_STRING_SET_WITH_SOFTTTL (1 << 18)
+#define TAIR_STRING_SET_WITH_GRACE (1 << 19)
+#define TAIR_STRING_SET_WITH_JITTER (1 << 20)
+#define TAIR_STRING_SET_WITH_RECOMPUTE (1 << 21)
+#define TAIR_STRING_SET_WITH_NS (1 << 22)
+#define TAIR_STRING_SET_WITH_TAGS (1 << 23)
+#define TAIR_STRING_SET_WITH_KEEPVERSIONS (1 << 24)
+#define TAIR_STRING_SET_WITH_KEEPFOR (1 << 25)
+
+#define TAIRSTRING_REPLY_WITH_FLAGS (1 << 0)
+#define TAIRSTRING_REPLY_WITH_DIGEST (1 << 1)
+#define TAIRSTRING_REPLY_REFRESH (1 << 2) /* Set by the reader, see earlyRefresh(). */
 
 #define TAIRSTRING_ENCVER_VER_1 0
+#define TAIRSTRING_ENCVER_VER_2 1 /* Adds the optional per key state. */
+
+/* Bits of the optional per key state saved in the RDB. */
+#define TAIRSTRING_EXT_REQIDS (1 << 0)
+#define TAIRSTRING_EXT_LOCK (1 << 1)
+#define TAIRSTRING_EXT_SEM (1 << 2)
+#define TAIRSTRING_EXT_WINDOW (1 << 3)
+#define TAIRSTRING_EXT_DECAY (1 << 4)
+#define TAIRSTRING_EXT_VECTOR (1 << 5)
+#define TAIRSTRING_EXT_LEASE (1 << 6)
+#define TAIRSTRING_EXT_SOFTTTL (1 << 7)
+#define TAIRSTRING_EXT_RECOMPUTE (1 << 8)
+#define TAIRSTRING_EXT_NS (1 << 9)
+#define TAIRSTRING_EXT_TAGS (1 << 10)
+#define TAIRSTRING_EXT_HISTORY (1 << 11)
+#define TAIRSTRING_EXT_RATELIMIT (1 << 12) /* No payload. */
+#define TAIRSTRING_EXT_ALL                                                                                     \
+    (TAIRSTRING_EXT_REQIDS | TAIRSTRING_EXT_LOCK | TAIRSTRING_EXT_SEM | TAIRSTRING_EXT_WINDOW                  \
+     | TAIRSTRING_EXT_DECAY | TAIRSTRING_EXT_VECTOR | TAIRSTRING_EXT_LEASE | TAIRSTRING_EXT_SOFTTTL            \
+     | TAIRSTRING_EXT_RECOMPUTE | TAIRSTRING_EXT_NS | TAIRSTRING_EXT_TAGS | TAIRSTRING_EXT_HISTORY            \
+     | TAIRSTRING_EXT_RATELIMIT)
+
+#define TAIRSTRING_REQID_MAX 16
+#define TAIRSTRING_REQID_WINDOW_DEFAULT 60000
+
+#define TAIRSTRING_RESERVE_MAX_SEGMENTS 16
+
+#define TAIRSTRING_SEM_MAX_LIMIT 1024
+
+#define TAIRSTRING_LOCK_RELEASED 1 /* A deadline in the past, the key stays a lock. */
+
+#define TAIRSTRING_RATELIMIT_MAX_RATE 1000000
+#define TAIRSTRING_RATELIMIT_MAX_BURST 1000000000
+
+#define TAIRSTRING_WINDOW_MAX_BUCKETS 4096
+
+#define TAIRSTRING_TAGS_MAX 32
+#define TAIRSTRING_INVALIDATE_BATCH 1000 /* Keys per timer tick. */
+#define TAIRSTRING_INVALIDATE_PERIOD 1
+
+#define TAIRSTRING_HISTORY_MAX 64
+
+#define TAIRSTRING_INT_STR_SIZE_LIMIT 20 /* Longest value the server may keep int encoded. */
+
+#define TAIRSTRING_VECTOR_INT32 0
+#define TAIRSTRING_VECTOR_INT64 1
+#define TAIRSTRING_VECTOR_FLOAT 2
+#define TAIRSTRING_VECTOR_MAX_LEN 65536
+
+#define TAIRSTRING_DIGEST_SEED 0xadc83b19
+#define TAIRSTRING_DIGEST_LEN 16
 
 static RedisModuleType *TairStringType;
 
 #pragma pack(1)
+/* A request already applied to the key, remembered until expire_at so that a
+ * retried EXINCRBY ... REQID gets the original result back. size is num, or
+ * the size of a segment with RESERVE, segments being 0 without. */
+typedef struct TairStringReqId {
+    RedisModuleString *id;
+    long long value;
+    uint64_t version;
+    long long expire_at;
+    long long size;
+    uint32_t segments;
+} TairStringReqId;
+
+/* A holder of a semaphore permit. */
+typedef struct TairStringHolder {
+    RedisModuleString *id;
+    long long expire_at;
+} TairStringHolder;
+
+/* A windowed counter, see rotateWindow(). */
+typedef struct TairStringWindow {
+    long long bucket_ms;
+    uint32_t nbuckets;
+    long long head; /* Epoch of the newest bucket. */
+    long long *counts;
+} TairStringWindow;
+
+/* A packed numeric vector, see createVector(). */
+typedef struct TairStringVector {
+    uint8_t type;
+    uint32_t len;
+    void *data;
+} TairStringVector;
+
+/* A replaced version kept for EXGET ... VERSION. */
+typedef struct TairStringVersion {
+    uint64_t version;
+    uint32_t flags;
+    long long replaced_at;
+    RedisModuleString *value;
+} TairStringVersion;
+
+/* Optional per key state, only allocated by the commands that need it so that
+ * plain keys only pay for a NULL pointer. */
+typedef struct TairStringExt {
+    uint32_t nreqids;
+    TairStringReqId *reqids;
+    long long lock_deadline; /* Absolute, 0 if the key is not a lock. */
+    int semaphore;            /* Set while the key is a semaphore, even with no holders. */
+    uint32_t nholders;
+    TairStringHolder *holders;
+    TairStringWindow *window;
+    int ratelimiter;          /* Set while the value is the TAT of EXRATELIMIT. */
+    long long decay_halflife; /* 0 if the value does not decay. */
+    long long decay_ts;       /* When the value was last brought up to date. */
+    uint64_t decay_version;   /* The version the decay state belongs to. */
+    TairStringVector *vector;
+    uint64_t lease_token; /* Set while the key is a lease placeholder. */
+    long long soft_expire_at; /* When the value becomes stale, see EXSET ... SOFTTTL. */
+    uint64_t soft_version;    /* The version the soft expire belongs to. */
+    int soft_refreshing;      /* A stale reader was already told to refresh. */
+    long long recompute_ms;   /* How long the value takes to rebuild, see earlyRefresh(). */
+    uint64_t recompute_version;
+    int ns_stamped;           /* Written with EXSET ... NS, see namespaceStale(). */
+    long long ns_generation;
+    uint64_t ns_version;
+    uint32_t ntags;           /* Tags of EXSET ... TAGS, see the tag index. */
+    RedisModuleString **tags;
+    int tag_dbid;             /* Where the key is indexed. */
+    RedisModuleString *tag_key;
+    uint32_t keep_versions;   /* History of EXSET ... KEEPVERSIONS/KEEPFOR, see historyPush(). */
+    long long keep_for;
+    uint32_t nhistory;
+    TairStringVersion *history; /* Oldest first. */
+} TairStringExt;
+
 typedef struct TairStringObj {
     uint64_t version;
     uint32_t flags;
     RedisModuleString *value;
+    uint64_t digest; /* Cached digest of value, 0 if not computed yet. */
+    TairStringExt *ext;
 } TairStringObj;
 
 static struct TairStringObj *createTairStringTypeObject(void) {
     return (TairStringObj *)RedisModule_Calloc(1, sizeof(TairStringObj));
 }
 
+static TairStringExt *tairStringObjExt(TairStringObj *o) {
+    if (o->ext == NULL) {
+        o->ext = RedisModule_Calloc(1, sizeof(TairStringExt));
+    }
+    return o->ext;
+}
+
+static void TairStringTypeReleaseExt(TairStringExt *ext) {
+    uint32_t j;
+    for (j = 0; j < ext->nreqids; j++) {
+        RedisModule_FreeString(NULL, ext->reqids[j].id);
+    }
+    RedisModule_Free(ext->reqids);
+    for (j = 0; j < ext->nholders; j++) {
+        RedisModule_FreeString(NULL, ext->holders[j].id);
+    }
+    RedisModule_Free(ext->holders);
+    if (ext->window) {
+        RedisModule_Free(ext->window->counts);
+        RedisModule_Free(ext->window);
+    }
+    if (ext->vector) {
+        RedisModule_Free(ext->vector->data);
+        RedisModule_Free(ext->vector);
+    }
+    for (j = 0; j < ext->ntags; j++) {
+        RedisModule_FreeString(NULL, ext->tags[j]);
+    }
+    RedisModule_Free(ext->tags);
+    if (ext->tag_key) {
+        RedisModule_FreeString(NULL, ext->tag_key);
+    }
+    for (j = 0; j < ext->nhistory; j++) {
+        RedisModule_FreeString(NULL, ext->history[j].value);
+    }
+    RedisModule_Free(ext->history);
+    RedisModule_Free(ext);
+}
+
 static void TairStringTypeReleaseObject(struct TairStringObj *o) {
     if (!o) return;
 
@@ -67,9 +255,296 @@ static void TairStringTypeReleaseObject(struct TairStringObj *o) {
         RedisModule_FreeString(NULL, o->value);
     }
 
+    if (o->ext) {
+        TairStringTypeReleaseExt(o->ext);
+    }
+
     RedisModule_Free(o);
 }
 
+/* Return the entry of id if it has not expired yet, or NULL. */
+static TairStringReqId *lookupReqId(TairStringObj *o, RedisModuleString *id, long long now) {
+    if (o->ext == NULL) return NULL;
+
+    uint32_t j;
+    for (j = 0; j < o->ext->nreqids; j++) {
+        TairStringReqId *r = &o->ext->reqids[j];
+        if (r->expire_at > now && RedisModule_StringCompare(r->id, id) == 0) return r;
+    }
+    return NULL;
+}
+
+/* Remember id in the ring of the key. Once TAIRSTRING_REQID_MAX requests are
+ * held, an expired entry or else the one closest to expiring is replaced. */
+static void addReqId(TairStringObj *o, RedisModuleString *id, long long value, uint64_t version,
+                     long long expire_at, long long size, uint32_t segments) {
+    TairStringExt *ext = tairStringObjExt(o);
+    TairStringReqId *r = NULL;
+    uint32_t j;
+
+    for (j = 0; j < ext->nreqids; j++) {
+        if (RedisModule_StringCompare(ext->reqids[j].id, id) == 0) {
+            r = &ext->reqids[j];
+            break;
+        }
+    }
+
+    if (r == NULL && ext->nreqids < TAIRSTRING_REQID_MAX) {
+        ext->reqids = RedisModule_Realloc(ext->reqids, sizeof(TairStringReqId) * (ext->nreqids + 1));
+        r = &ext->reqids[ext->nreqids++];
+        r->id = RedisModule_CreateStringFromString(NULL, id);
+    } else if (r == NULL) {
+        r = &ext->reqids[0];
+        for (j = 1; j < ext->nreqids; j++) {
+            if (ext->reqids[j].expire_at < r->expire_at) r = &ext->reqids[j];
+        }
+        RedisModule_FreeString(NULL, r->id);
+        r->id = RedisModule_CreateStringFromString(NULL, id);
+    }
+
+    r->value = value;
+    r->version = version;
+    r->expire_at = expire_at;
+    r->size = size;
+    r->segments = segments;
+}
+
+/* A decaying counter halves its value every decay_halflife milliseconds
+ * since decay_ts. The state only holds for the version it was set at, so any
+ * other write of the key makes it a plain value again. */
+static int decayActive(const TairStringObj *o) {
+    return o->ext && o->ext->decay_halflife && o->ext->decay_version == o->version;
+}
+
+static long double decayValue(const TairStringObj *o, long double value, long long now) {
+    long long elapsed = now - o->ext->decay_ts;
+    if (elapsed <= 0) return value;
+    return value * exp2l(-(long double)elapsed / o->ext->decay_halflife);
+}
+
+static void setDecay(TairStringObj *o, long long halflife, long long ts) {
+    TairStringExt *ext = tairStringObjExt(o);
+    ext->decay_halflife = halflife;
+    ext->decay_ts = ts;
+    ext->decay_version = o->version;
+}
+
+/* EXLEASE creates a placeholder for a missing key until its holder fills it
+ * with EXSET ... LEASE. It has never been written, hence version 0, and
+ * reads treat it as missing. */
+static int isLeasePlaceholder(const TairStringObj *o) {
+    return o->version == 0 && o->ext && o->ext->lease_token;
+}
+
+/* A plain value write (EXSET, EXINCRBY, EXAPPEND, ...) turns the key back
+ * into an ordinary value. A lock overwritten that way is no longer held, so
+ * that its owner and fencing token can not change behind the holder. The
+ * holders of a semaphore, the buckets of a windowed counter and the elements
+ * of a vector are dropped, the AOF rewrite would otherwise replay them over
+ * the new value. */
+static void dropSpecialState(TairStringObj *o) {
+    TairStringExt *ext = o->ext;
+    if (ext == NULL) return;
+
+    uint32_t j;
+    ext->lock_deadline = 0;
+    ext->semaphore = 0;
+    ext->ratelimiter = 0;
+    for (j = 0; j < ext->nholders; j++) {
+        RedisModule_FreeString(NULL, ext->holders[j].id);
+    }
+    RedisModule_Free(ext->holders);
+    ext->holders = NULL;
+    ext->nholders = 0;
+    if (ext->window) {
+        RedisModule_Free(ext->window->counts);
+        RedisModule_Free(ext->window);
+        ext->window = NULL;
+    }
+    if (ext->vector) {
+        RedisModule_Free(ext->vector->data);
+        RedisModule_Free(ext->vector);
+        ext->vector = NULL;
+    }
+}
+
+/* Same as dropSpecialState(), for writes other than EXINCRBY, which also
+ * forget the requests applied so far: a retry must not get back a result
+ * the counter was since reset from. */
+static void dropValueState(TairStringObj *o) {
+    TairStringExt *ext = o->ext;
+    if (ext == NULL) return;
+
+    uint32_t j;
+    for (j = 0; j < ext->nreqids; j++) {
+        RedisModule_FreeString(NULL, ext->reqids[j].id);
+    }
+    RedisModule_Free(ext->reqids);
+    ext->reqids = NULL;
+    ext->nreqids = 0;
+    dropSpecialState(o);
+}
+
+/* A value written with SOFTTTL is still served once soft_expire_at passed
+ * but flagged as stale, until the hard expire of the key. Like the decay
+ * state it only holds for the version it was set at. */
+static int softTTLActive(const TairStringObj *o) {
+    return o->ext && o->ext->soft_expire_at && o->ext->soft_version == o->version;
+}
+
+static void setSoftTTL(TairStringObj *o, long long soft_expire_at) {
+    TairStringExt *ext = tairStringObjExt(o);
+    ext->soft_expire_at = soft_expire_at;
+    ext->soft_version = o->version;
+    ext->soft_refreshing = 0;
+}
+
+static void setRecompute(TairStringObj *o, long long recompute_ms) {
+    TairStringExt *ext = tairStringObjExt(o);
+    ext->recompute_ms = recompute_ms;
+    ext->recompute_version = o->version;
+}
+
+static int recomputeActive(const TairStringObj *o) {
+    return o->ext && o->ext->recompute_ms && o->ext->recompute_version == o->version;
+}
+
+/* XFetch: a value that takes recompute_ms to rebuild is handed out with a
+ * REFRESH marker before it expires, with a probability that grows as the
+ * (soft) expire gets closer, i.e. once now - recompute_ms * ln(rand) reaches
+ * it. Refreshes are thus spread over time instead of all readers missing at
+ * once. */
+static int earlyRefresh(RedisModuleKey *key, const TairStringObj *o) {
+    if (!recomputeActive(o)) return 0;
+
+    long long now = RedisModule_Milliseconds(), expire_at;
+    if (softTTLActive(o)) {
+        expire_at = o->ext->soft_expire_at;
+    } else {
+        long long pttl = RedisModule_GetExpire(key);
+        if (pttl == REDISMODULE_NO_EXPIRE) return 0;
+        expire_at = now + pttl;
+    }
+
+    uint64_t r;
+    RedisModule_GetRandomBytes((unsigned char *)&r, sizeof(r));
+    double u = (double)((r >> 11) + 1) / (double)(1ULL << 53);
+    return now - o->ext->recompute_ms * log(u) >= expire_at;
+}
+
+static void setNamespace(TairStringObj *o, long long generation) {
+    TairStringExt *ext = tairStringObjExt(o);
+    ext->ns_stamped = 1;
+    ext->ns_generation = generation;
+    ext->ns_version = o->version;
+}
+
+static int nsActive(const TairStringObj *o) {
+    return o->ext && o->ext->ns_stamped && o->ext->ns_version == o->version;
+}
+
+/* The generation of a namespace is the integer value of its key, a missing
+ * key is generation 0. Replies with an error and returns REDISMODULE_ERR if
+ * it is not an integer. */
+static int namespaceGeneration(RedisModuleCtx *ctx, RedisModuleString *nskey, long long *generation) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, nskey, REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    *generation = 0;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+    if (RedisModule_StringToLongLong(o->value, generation) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NS);
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+/* JITTER pct shortens each expire by a random amount of up to pct percent,
+ * so that keys written together with the same TTL do not expire together.
+ * Writes replicate the resulting absolute expire, replicas agree with it. */
+static int mstring2jitter(RedisModuleString *jitter_p, long long *pct) {
+    *pct = 0;
+    if (jitter_p == NULL) return REDISMODULE_OK;
+    if (RedisModule_StringToLongLong(jitter_p, pct) != REDISMODULE_OK || *pct < 0 || *pct > 100) {
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+static long long jitterExpire(long long milliseconds, long long pct) {
+    if (pct == 0 || milliseconds <= 0) return milliseconds;
+
+    uint64_t r;
+    long long span = (long long)((long double)milliseconds * pct / 100);
+    RedisModule_GetRandomBytes((unsigned char *)&r, sizeof(r));
+    return milliseconds - (long long)(r % ((uint64_t)span + 1));
+}
+
+/* Tokens start from the load time so that they keep growing across restarts,
+ * like the change log sequence. */
+static uint64_t TairStringLeaseNext;
+
+/* Hash used by the digest forms of CAS/CAD/EXCAS, clients are expected to
+ * compute the same MurmurHash64A over the value to build the expected digest. */
+static uint64_t stringDigest(const char *ptr, size_t len) {
+    return m_murmurhash64a(ptr, (int)len, TAIRSTRING_DIGEST_SEED);
+}
+
+/* The digest of o is computed on first use and then cached until the next
+ * write, see notifyKeyModified(). A value hashing to 0 is simply never
+ * cached. */
+static uint64_t tairStringObjDigest(TairStringObj *o) {
+    if (o->digest == 0) {
+        size_t len;
+        const char *ptr = RedisModule_StringPtrLen(o->value, &len);
+        o->digest = stringDigest(ptr, len);
+    }
+    return o->digest;
+}
+
+/* Parse a digest given as 16 hex digits. */
+static int mstring2digest(RedisModuleString *val, uint64_t *digest) {
+    size_t len, j;
+    const char *ptr = RedisModule_StringPtrLen(val, &len);
+    if (len != TAIRSTRING_DIGEST_LEN) return REDISMODULE_ERR;
+
+    uint64_t d = 0;
+    for (j = 0; j < len; j++) {
+        int c = tolower((unsigned char)ptr[j]);
+        if (c >= '0' && c <= '9') {
+            d = (d << 4) | (uint64_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            d = (d << 4) | (uint64_t)(c - 'a' + 10);
+        } else {
+            return REDISMODULE_ERR;
+        }
+    }
+    *digest = d;
+    return REDISMODULE_OK;
+}
+
+static void replyWithDigest(RedisModuleCtx *ctx, uint64_t digest) {
+    char buf[TAIRSTRING_DIGEST_LEN + 1];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)digest);
+    RedisModule_ReplyWithStringBuffer(ctx, buf, TAIRSTRING_DIGEST_LEN);
+}
+
+/* The EX*SET commands restore internal state as it is replicated and
+ * rewritten to the AOF, clients could forge it with them. */
+static int internalCallAllowed(RedisModuleCtx *ctx) {
+    if (RedisModule_GetContextFlags(ctx) & (REDISMODULE_CTX_FLAGS_REPLICATED | REDISMODULE_CTX_FLAGS_LOADING)) {
+        return 1;
+    }
+    RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_INTERNAL);
+    return 0;
+}
+
 static int mstring2ld(RedisModuleString *val, long double *r_val) {
     if (!val) return REDISMODULE_ERR;
 
@@ -92,17 +567,41 @@ static int mstringcasecmp(const RedisModuleString *rs1, const char *s2) {
     return strncasecmp(s1, s2, n1);
 }
 
+/* The arguments of the options of parseAndGetExFlags(). */
+typedef struct TairStringExArgs {
+    RedisModuleString *expire;
+    RedisModuleString *version;
+    RedisModuleString *flags;
+    RedisModuleString *defaultvalue;
+    RedisModuleString *min;
+    RedisModuleString *max;
+    RedisModuleString *reqid;
+    RedisModuleString *window;
+    RedisModuleString *reserve;
+    RedisModuleString *halflife;
+    RedisModuleString *lease;
+    RedisModuleString *softttl;
+    RedisModuleString *grace;
+    RedisModuleString *jitter;
+    RedisModuleString *recompute;
+    RedisModuleString *ns;
+    RedisModuleString **tags; /* The count of TAGS, followed by the tags. */
+    RedisModuleString *keepversions;
+    RedisModuleString *keepfor;
+} TairStringExArgs;
+
 /* Parse the command **argv and get those arguments. Return ex_flags. If parsing
  * get failed, It would reply with syntax error. The first appearance would be
  * accepted if there are multiple appearance of a same group, For example: "EX
  * 3 PX 4000 EXAT 127", the "EX 3" would be accepted and the other two would be
- * ignored.
+ * ignored. The arguments of the options are stored in args, which is reset
+ * first, options that are not given being NULL. Only the options in
+ * allow_flags are accepted.
  * */
-static int parseAndGetExFlags(RedisModuleString **argv, int argc, int start, int *ex_flag, RedisModuleString **expire_p,
-                              RedisModuleString **version_p, RedisModuleString **flags_p,
-                              RedisModuleString **defaultvalue_p, RedisModuleString **min_p,
-                              RedisModuleString **max_p, unsigned int allow_flags) {
+static int parseAndGetExFlags(RedisModuleString **argv, int argc, int start, int *ex_flag, TairStringExArgs *args,
+                              unsigned int allow_flags) {
     int j, ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    memset(args, 0, sizeof(*args));
     for (j = start; j < argc; j++) {
         RedisModuleString *next = (j == argc - 1) ? NULL : argv[j + 1];
 
@@ -116,77 +615,177 @@ static int parseAndGetExFlags(RedisModuleString **argv, int argc, int start, int
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_XX;
-        } else if (expire_p != NULL && !mstringcasecmp(argv[j], "ex") && next) {
+        } else if (!mstringcasecmp(argv[j], "ex") && next) {
             if (ex_flags & (TAIR_STRING_SET_PX | TAIR_STRING_SET_EX | TAIR_STRING_SET_KEEPTTL)) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_EX;
-            *expire_p = next;
+            args->expire = next;
             j++;
-        } else if (expire_p != NULL && !mstringcasecmp(argv[j], "exat") && next) {
+        } else if (!mstringcasecmp(argv[j], "exat") && next) {
             if (ex_flags & (TAIR_STRING_SET_PX | TAIR_STRING_SET_EX | TAIR_STRING_SET_KEEPTTL)) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_EX;
             ex_flags |= TAIR_STRING_SET_ABS_EXPIRE;
-            *expire_p = next;
+            args->expire = next;
             j++;
-        } else if (expire_p != NULL && !mstringcasecmp(argv[j], "px") && next) {
+        } else if (!mstringcasecmp(argv[j], "px") && next) {
             if (ex_flags & (TAIR_STRING_SET_PX | TAIR_STRING_SET_EX | TAIR_STRING_SET_KEEPTTL)) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_PX;
-            *expire_p = next;
+            args->expire = next;
             j++;
-        } else if (expire_p != NULL && !mstringcasecmp(argv[j], "pxat") && next) {
+        } else if (!mstringcasecmp(argv[j], "pxat") && next) {
             if (ex_flags & (TAIR_STRING_SET_PX | TAIR_STRING_SET_EX | TAIR_STRING_SET_KEEPTTL)) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_PX;
             ex_flags |= TAIR_STRING_SET_ABS_EXPIRE;
-            *expire_p = next;
+            args->expire = next;
             j++;
-        } else if (version_p != NULL && !mstringcasecmp(argv[j], "ver") && next) {
-            if (ex_flags & (TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER)) {
+        } else if (!mstringcasecmp(argv[j], "ver") && next) {
+            if (ex_flags & (TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_WITH_VER;
-            *version_p = next;
+            args->version = next;
             j++;
-        } else if (version_p != NULL && !mstringcasecmp(argv[j], "abs") && next) {
-            if (ex_flags & (TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER)) {
+        } else if (!mstringcasecmp(argv[j], "abs") && next) {
+            if (ex_flags & (TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_WITH_ABS_VER;
-            *version_p = next;
+            args->version = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "vergt") && next) {
+            if (ex_flags & (TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_GT_VER;
+            args->version = next;
             j++;
-        } else if (flags_p != NULL && !mstringcasecmp(argv[j], "flags") && next) {
+        } else if (!mstringcasecmp(argv[j], "flags") && next) {
             if (ex_flags & TAIR_STRING_SET_WITH_FLAGS) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_WITH_FLAGS;
-            *flags_p = next;
+            args->flags = next;
             j++;
-        } else if (defaultvalue_p != NULL && !mstringcasecmp(argv[j], "def") && next) { /* DEF disabled if XX set. */
+        } else if (!mstringcasecmp(argv[j], "def") && next) { /* DEF disabled if XX set. */
             if (ex_flags & TAIR_STRING_SET_WITH_DEF) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_WITH_DEF;
-            *defaultvalue_p = next;
+            args->defaultvalue = next;
             j++;
-        } else if (min_p != NULL && !mstringcasecmp(argv[j], "min") && next) {
-            if (*min_p != NULL) {
+        } else if (!mstringcasecmp(argv[j], "min") && next) {
+            if (args->min != NULL) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_WITH_BOUNDARY;
-            *min_p = next;
+            args->min = next;
             j++;
-        } else if (max_p != NULL && !mstringcasecmp(argv[j], "max") && next) {
-            if (*max_p != NULL) {
+        } else if (!mstringcasecmp(argv[j], "max") && next) {
+            if (args->max != NULL) {
                 return REDISMODULE_ERR;
             }
             ex_flags |= TAIR_STRING_SET_WITH_BOUNDARY;
-            *max_p = next;
+            args->max = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "reqid") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_REQID) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_REQID;
+            args->reqid = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "dedupwindow") && next) {
+            if (args->window != NULL) {
+                return REDISMODULE_ERR;
+            }
+            args->window = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "reserve") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_RESERVE) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_RESERVE;
+            args->reserve = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "halflife") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_HALFLIFE) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_HALFLIFE;
+            args->halflife = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "lease") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_LEASE) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_LEASE;
+            args->lease = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "softttl") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_SOFTTTL) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_SOFTTTL;
+            args->softttl = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "grace") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_GRACE) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_GRACE;
+            args->grace = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "jitter") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_JITTER) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_JITTER;
+            args->jitter = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "recompute") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_RECOMPUTE) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_RECOMPUTE;
+            args->recompute = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "ns") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_NS) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_NS;
+            args->ns = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "tags") && next) {
+            /* TAGS <count> <tag> [<tag> ...], args->tags points to the count. */
+            long long ntags;
+            if ((ex_flags & TAIR_STRING_SET_WITH_TAGS) || RedisModule_StringToLongLong(next, &ntags) != REDISMODULE_OK
+                || ntags < 1 || ntags > TAIRSTRING_TAGS_MAX || ntags > argc - j - 2) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_TAGS;
+            args->tags = argv + j + 1;
+            j += 1 + ntags;
+        } else if (!mstringcasecmp(argv[j], "keepversions") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_KEEPVERSIONS) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_KEEPVERSIONS;
+            args->keepversions = next;
+            j++;
+        } else if (!mstringcasecmp(argv[j], "keepfor") && next) {
+            if (ex_flags & TAIR_STRING_SET_WITH_KEEPFOR) {
+                return REDISMODULE_ERR;
+            }
+            ex_flags |= TAIR_STRING_SET_WITH_KEEPFOR;
+            args->keepfor = next;
             j++;
         } else if (!mstringcasecmp(argv[j], "nonegative")) {
             ex_flags |= TAIR_STRING_SET_NONEGATIVE;
@@ -201,8 +800,18 @@ static int parseAndGetExFlags(RedisModuleString **argv, int argc, int start, int
             return REDISMODULE_ERR;
         }
     }
-    
-if ((~allow_flags) & ex_flags) {
+
+    /* JITTER only makes sense together with an expire. */
+    if ((ex_flags & TAIR_STRING_SET_WITH_JITTER) && !(ex_flags & (TAIR_STRING_SET_EX | TAIR_STRING_SET_PX))) {
+        return REDISMODULE_ERR;
+    }
+
+    /* DEDUPWINDOW only makes sense together with REQID. */
+    if (args->window != NULL && !(ex_flags & TAIR_STRING_SET_WITH_REQID)) {
+        return REDISMODULE_ERR;
+    }
+
+    if ((~allow_flags) & ex_flags) {
         return REDISMODULE_ERR;
     }
 
@@ -210,1077 +819,5106 @@ if ((~allow_flags) & ex_flags) {
     return REDISMODULE_OK;
 }
 
-/* ========================= "tairstring" type commands =======================*/
+/* The NS key of EXGET and EXLEASE, whose other options are flags or take a
+ * single argument. */
+static RedisModuleString *scanNamespaceKey(RedisModuleString **argv, int argc, int start) {
+    int j;
+    for (j = start; j + 1 < argc; j++) {
+        if (!mstringcasecmp(argv[j], "ns")) {
+            return argv[j + 1];
+        } else if (!mstringcasecmp(argv[j], "ifnewer") || !mstringcasecmp(argv[j], "minversion")
+                   || !mstringcasecmp(argv[j], "version")) {
+            j++;
+        }
+    }
+    return NULL;
+}
 
-/* EXSET <key> <value> [EX/EXAT/PX/PXAT time] [NX/XX] [VER/ABS version] [FLAGS flags] [WITHVERSION] [KEEPTTL] */
-int TairStringTypeSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    RedisModule_AutoMemory(ctx);
+/* Answer a keys position request of a command with an NS option: the key
+ * itself and nskey, the argument parsed as the namespace key, if any. The
+ * namespace key is read by these commands, so cluster mode has to route and
+ * check it like any other key. */
+static int declareNamespaceKeys(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, RedisModuleString *nskey) {
+    int j;
+    if (argc > 1) RedisModule_KeyAtPos(ctx, 1);
+    for (j = 2; nskey && j < argc; j++) {
+        if (argv[j] == nskey) {
+            RedisModule_KeyAtPos(ctx, j);
+            break;
+        }
+    }
+    return REDISMODULE_OK;
+}
 
-    if (argc < 3) {
-        return RedisModule_WrongArity(ctx);
+/* ================================ tag index ================================*/
+
+/* Keys written with EXSET ... TAGS are indexed by <dbid><tag>, each entry
+ * being a dict of the tagged key names pointing to their object. Entries
+ * are removed by the free callback of the object, which also runs for
+ * expired and evicted keys, using the name and db saved in the object since
+ * the callback does not get them. Async flushes free objects in a background
+ * thread, hence the lock. RENAME and RESTORE are followed through keyspace
+ * events, MOVE is not. */
+static RedisModuleDict *TairStringTagIndex;
+static pthread_mutex_t TairStringTagLock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *tagIndexKey(int dbid, RedisModuleString *tag, char *buf, size_t bufsize, size_t *len) {
+    size_t taglen;
+    const char *tagptr = RedisModule_StringPtrLen(tag, &taglen);
+
+    *len = sizeof(dbid) + taglen;
+    char *p = *len <= bufsize ? buf : RedisModule_Alloc(*len);
+    memcpy(p, &dbid, sizeof(dbid));
+    memcpy(p + sizeof(dbid), tagptr, taglen);
+    return p;
+}
+
+/* Called with the lock held. */
+static void tagIndexUpdate(TairStringObj *o, int add) {
+    TairStringExt *ext = o->ext;
+    uint32_t j;
+    size_t keylen;
+    const char *keyptr = RedisModule_StringPtrLen(ext->tag_key, &keylen);
+
+    for (j = 0; j < ext->ntags; j++) {
+        char buf[256];
+        size_t len;
+        char *ikey = tagIndexKey(ext->tag_dbid, ext->tags[j], buf, sizeof(buf), &len);
+        RedisModuleDict *keys = RedisModule_DictGetC(TairStringTagIndex, ikey, len, NULL);
+        if (add) {
+            if (keys == NULL) {
+                keys = RedisModule_CreateDict(NULL);
+                RedisModule_DictSetC(TairStringTagIndex, ikey, len, keys);
+            }
+            RedisModule_DictReplaceC(keys, (void *)keyptr, keylen, o);
+        } else if (keys && RedisModule_DictGetC(keys, (void *)keyptr, keylen, NULL) == o) {
+            /* The name may already belong to another object. */
+            RedisModule_DictDelC(keys, (void *)keyptr, keylen, NULL);
+            if (RedisModule_DictSize(keys) == 0) {
+                RedisModule_DictDelC(TairStringTagIndex, ikey, len, NULL);
+                RedisModule_FreeDict(NULL, keys);
+            }
+        }
+        if (ikey != buf) RedisModule_Free(ikey);
     }
+}
 
-    long long milliseconds = 0, expire = 0, version = 0, flags = 0;
-    RedisModuleString *expire_p = NULL, *version_p = NULL, *flags_p = NULL;
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | 
-                      TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL | TAIR_STRING_SET_WITH_VER |
-                      TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_FLAGS | TAIR_STRING_RETURN_WITH_VER;
-    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &expire_p, &version_p, &flags_p, NULL, NULL, NULL, allow_flags) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+/* Index o under keyname in dbid, dropping it from where it was indexed
+ * before, if anywhere. */
+static void tagIndexMove(TairStringObj *o, int dbid, RedisModuleString *keyname) {
+    TairStringExt *ext = o->ext;
+    pthread_mutex_lock(&TairStringTagLock);
+    if (ext->tag_key) {
+        tagIndexUpdate(o, 0);
+        RedisModule_FreeString(NULL, ext->tag_key);
     }
+    ext->tag_dbid = dbid;
+    ext->tag_key = RedisModule_CreateStringFromString(NULL, keyname);
+    tagIndexUpdate(o, 1);
+    pthread_mutex_unlock(&TairStringTagLock);
+}
 
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+/* Whether keyname is indexed in dbid under any of tags, called with the lock
+ * held. */
+static int tagIndexHasKey(int dbid, RedisModuleString *keyname, RedisModuleString **tags, uint32_t ntags) {
+    uint32_t j;
+    size_t keylen;
+    const char *keyptr = RedisModule_StringPtrLen(keyname, &keylen);
+    int found = 0;
+
+    for (j = 0; j < ntags && !found; j++) {
+        char buf[256];
+        size_t len;
+        char *ikey = tagIndexKey(dbid, tags[j], buf, sizeof(buf), &len);
+        RedisModuleDict *keys = RedisModule_DictGetC(TairStringTagIndex, ikey, len, NULL);
+        found = keys && RedisModule_DictGetC(keys, (void *)keyptr, keylen, NULL) != NULL;
+        if (ikey != buf) RedisModule_Free(ikey);
     }
+    return found;
+}
 
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+/* Replace the tags of o, an empty list removes it from the index. A NULL
+ * keyname keeps the tags without indexing o, see tagIndexMove(). */
+static void setTags(TairStringObj *o, int dbid, RedisModuleString *keyname, RedisModuleString **tags, uint32_t ntags) {
+    if (ntags == 0 && (o->ext == NULL || o->ext->ntags == 0)) return;
+
+    TairStringExt *ext = tairStringObjExt(o);
+    uint32_t j;
+    pthread_mutex_lock(&TairStringTagLock);
+    if (ext->tag_key) {
+        tagIndexUpdate(o, 0);
+        RedisModule_FreeString(NULL, ext->tag_key);
+        ext->tag_key = NULL;
+    }
+    for (j = 0; j < ext->ntags; j++) {
+        RedisModule_FreeString(NULL, ext->tags[j]);
     }
+    ext->tags = RedisModule_Realloc(ext->tags, sizeof(RedisModuleString *) * ntags);
+    ext->ntags = ntags;
+    for (j = 0; j < ntags; j++) {
+        ext->tags[j] = RedisModule_CreateStringFromString(NULL, tags[j]);
+    }
+    if (ntags && keyname) {
+        ext->tag_dbid = dbid;
+        ext->tag_key = RedisModule_CreateStringFromString(NULL, keyname);
+        tagIndexUpdate(o, 1);
+    }
+    pthread_mutex_unlock(&TairStringTagLock);
+}
 
-    if ((NULL != flags_p) && (RedisModule_StringToLongLong(flags_p, &flags) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+/* Writes that keep the tags of o replicate as an EXSET, which drops them, so
+ * the tags are replicated again right after it. */
+static void replicateTags(RedisModuleCtx *ctx, RedisModuleString *keyname, TairStringObj *o) {
+    if (o->ext && o->ext->ntags) {
+        RedisModule_Replicate(ctx, "EXTAGSET", "sv", keyname, o->ext->tags, (size_t)o->ext->ntags);
     }
+}
 
-    if ((expire_p && expire <=0) || version < 0 || flags < 0 || flags > UINT_MAX) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+static void tagIndexRemove(TairStringObj *o) {
+    if (o->ext == NULL || o->ext->tag_key == NULL) return;
+    pthread_mutex_lock(&TairStringTagLock);
+    tagIndexUpdate(o, 0);
+    pthread_mutex_unlock(&TairStringTagLock);
+}
+
+static int hasTag(const TairStringObj *o, RedisModuleString *tag) {
+    uint32_t j;
+    if (o->ext == NULL) return 0;
+    for (j = 0; j < o->ext->ntags; j++) {
+        if (RedisModule_StringCompare(o->ext->tags[j], tag) == 0) return 1;
     }
+    return 0;
+}
 
-    TairStringObj *tair_string_obj = NULL;
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY == type) {
-        if (ex_flags & TAIR_STRING_SET_XX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
-        tair_string_obj = createTairStringTypeObject();
-        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
-    } else {
-        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
-            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-            return REDISMODULE_ERR;
-        }
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+/* ============================= version history =============================*/
 
-        if (ex_flags & TAIR_STRING_SET_NX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
+/* With EXSET ... KEEPVERSIONS/KEEPFOR the writes that replace the value of a
+ * key keep the previous version, so that readers told about a version a few
+ * milliseconds ago can still get it with EXGET ... VERSION. Replicas record
+ * the same versions from the replicated writes. Entries past the limits are
+ * only dropped by the next write or versioned read of the key. */
+static int historyActive(const TairStringObj *o) {
+    return o->ext && (o->ext->keep_versions || o->ext->keep_for);
+}
 
-        /* Version 0 means no version checking. */
-        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
-            return REDISMODULE_ERR;
-        }
+static void historyCompact(TairStringObj *o, long long now) {
+    TairStringExt *ext = o->ext;
+    uint32_t limit = ext->keep_versions ? ext->keep_versions : TAIRSTRING_HISTORY_MAX;
+    uint32_t j, drop = 0;
+    while (drop < ext->nhistory
+           && (ext->nhistory - drop > limit || (ext->keep_for && ext->history[drop].replaced_at + ext->keep_for <= now))) {
+        drop++;
     }
+    if (drop == 0) return;
 
-    if (ex_flags & TAIR_STRING_SET_WITH_ABS_VER) {
-        tair_string_obj->version = version;
-    } else {
-        tair_string_obj->version++;
+    for (j = 0; j < drop; j++) {
+        RedisModule_FreeString(NULL, ext->history[j].value);
     }
+    ext->nhistory -= drop;
+    memmove(ext->history, ext->history + drop, sizeof(TairStringVersion) * ext->nhistory);
+    if (ext->nhistory == 0) {
+        RedisModule_Free(ext->history);
+        ext->history = NULL;
+    }
+}
 
-    if (type != REDISMODULE_KEYTYPE_EMPTY) {
-        /* Free the old value. */
-        if (tair_string_obj->value) {
-            RedisModule_FreeString(ctx, tair_string_obj->value);
-        }
+/* The value is owned by the history from now on. */
+static void historyAppend(TairStringObj *o, uint64_t version, uint32_t flags, long long replaced_at,
+                          RedisModuleString *value) {
+    TairStringExt *ext = o->ext;
+    ext->history = RedisModule_Realloc(ext->history, sizeof(TairStringVersion) * (ext->nhistory + 1));
+    TairStringVersion *v = &ext->history[ext->nhistory++];
+    v->version = version;
+    v->flags = flags;
+    v->replaced_at = replaced_at;
+    v->value = value;
+}
+
+/* Keep value as the current version of o, which is about to be replaced. */
+static void historyPush(TairStringObj *o, RedisModuleString *value) {
+    long long now = RedisModule_Milliseconds();
+    historyAppend(o, o->version, o->flags, now, value);
+    historyCompact(o, now);
+}
+
+/* Called by every write that changes the value or version of o in place,
+ * before doing so. */
+static void historyRecord(TairStringObj *o) {
+    if (historyActive(o) && !isLeasePlaceholder(o)) {
+        historyPush(o, RedisModule_CreateStringFromString(NULL, o->value));
     }
-    tair_string_obj->value = argv[2];
-    /* Reuse the value to avoid memory copies. */
-    RedisModule_RetainString(NULL, argv[2]);
+}
 
-    if (ex_flags & TAIR_STRING_SET_WITH_FLAGS) {
-        tair_string_obj->flags = flags;
+/* Both limits 0 turn the history off and drop it. */
+static void setHistory(TairStringObj *o, uint32_t keep_versions, long long keep_for) {
+    if (keep_versions == 0 && keep_for == 0 && !historyActive(o)) return;
+
+    TairStringExt *ext = tairStringObjExt(o);
+    ext->keep_versions = keep_versions;
+    ext->keep_for = keep_for;
+    if (historyActive(o)) {
+        historyCompact(o, RedisModule_Milliseconds());
+        return;
     }
 
-    if (expire_p) {
-        if (ex_flags & TAIR_STRING_SET_EX) {
-            expire *= 1000;
+    uint32_t j;
+    for (j = 0; j < ext->nhistory; j++) {
+        RedisModule_FreeString(NULL, ext->history[j].value);
+    }
+    RedisModule_Free(ext->history);
+    ext->history = NULL;
+    ext->nhistory = 0;
+}
+
+static TairStringVersion *historyLookup(TairStringObj *o, uint64_t version) {
+    if (!historyActive(o)) return NULL;
+
+    historyCompact(o, RedisModule_Milliseconds());
+    uint32_t j;
+    for (j = 0; j < o->ext->nhistory; j++) {
+        if (o->ext->history[j].version == version) {
+            return &o->ext->history[j];
         }
-        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
-            /* Since the RedisModule_SetExpire interface can only set relative
-            expiration times, here we first convert the absolute time passed
-            in by the user to relative time. */
-            milliseconds = expire - RedisModule_Milliseconds();
-            if (milliseconds < 0) {
-                /* Time out now. */
-                milliseconds = 0;
-            }
-        } else {
-            milliseconds = expire;
+    }
+    return NULL;
+}
+
+/* ============================ EXWAIT waiters ===============================*/
+
+/* Clients blocked in EXWAIT are indexed by <dbid><keyname>, so that a write
+ * only has to walk the waiters of the key it touched. A second index maps the
+ * blocked client handle back to its waiter, which is what the timeout and
+ * disconnect callbacks get. */
+typedef struct TairStringWaiter {
+    RedisModuleBlockedClient *bc;
+    uint64_t version;
+    struct TairStringWaiterList *list;
+    struct TairStringWaiter *prev, *next;
+} TairStringWaiter;
+
+typedef struct TairStringWaiterList {
+    TairStringWaiter *head;
+    size_t keylen;
+    char key[];
+} TairStringWaiterList;
+
+/* What a woken up waiter replies with, value is NULL if the key is gone. */
+typedef struct TairStringWaitResult {
+    RedisModuleString *value;
+    uint64_t version;
+} TairStringWaitResult;
+
+static RedisModuleDict *TairStringWaitersByKey;
+static RedisModuleDict *TairStringWaitersByClient;
+
+static char *waiterIndexKey(RedisModuleCtx *ctx, RedisModuleString *keyname, char *buf, size_t bufsize, size_t *len) {
+    size_t keylen;
+    const char *keyptr = RedisModule_StringPtrLen(keyname, &keylen);
+    int dbid = RedisModule_GetSelectedDb(ctx);
+
+    *len = sizeof(dbid) + keylen;
+    char *p = *len <= bufsize ? buf : RedisModule_Alloc(*len);
+    memcpy(p, &dbid, sizeof(dbid));
+    memcpy(p + sizeof(dbid), keyptr, keylen);
+    return p;
+}
+
+static void addWaiter(RedisModuleCtx *ctx, RedisModuleString *keyname, RedisModuleBlockedClient *bc, uint64_t version) {
+    char buf[256];
+    size_t len;
+    char *ikey = waiterIndexKey(ctx, keyname, buf, sizeof(buf), &len);
+
+    TairStringWaiterList *list = RedisModule_DictGetC(TairStringWaitersByKey, ikey, len, NULL);
+    if (list == NULL) {
+        list = RedisModule_Alloc(sizeof(*list) + len);
+        list->head = NULL;
+        list->keylen = len;
+        memcpy(list->key, ikey, len);
+        RedisModule_DictSetC(TairStringWaitersByKey, list->key, list->keylen, list);
+    }
+    if (ikey != buf) RedisModule_Free(ikey);
+
+    TairStringWaiter *w = RedisModule_Alloc(sizeof(*w));
+    w->bc = bc;
+    w->version = version;
+    w->list = list;
+    w->prev = NULL;
+    w->next = list->head;
+    if (list->head) list->head->prev = w;
+    list->head = w;
+    RedisModule_DictSetC(TairStringWaitersByClient, &w->bc, sizeof(w->bc), w);
+}
+
+static void removeWaiter(TairStringWaiter *w) {
+    TairStringWaiterList *list = w->list;
+
+    RedisModule_DictDelC(TairStringWaitersByClient, &w->bc, sizeof(w->bc), NULL);
+    if (w->prev) {
+        w->prev->next = w->next;
+    } else {
+        list->head = w->next;
+    }
+    if (w->next) w->next->prev = w->prev;
+    RedisModule_Free(w);
+
+    if (list->head == NULL) {
+        RedisModule_DictDelC(TairStringWaitersByKey, list->key, list->keylen, NULL);
+        RedisModule_Free(list);
+    }
+}
+
+/* Wake up the waiters of list whose known version differs from the one of o.
+ * If o is NULL the key is gone and every waiter is woken up. */
+static void wakeWaiters(TairStringWaiterList *list, TairStringObj *o) {
+    TairStringWaiter *w = list->head, *next;
+    while (w) {
+        /* The list itself is freed together with its last waiter. */
+        next = w->next;
+        if (o == NULL || o->version != w->version) {
+            TairStringWaitResult *res = RedisModule_Alloc(sizeof(*res));
+            /* The value is copied since it may be appended in place before
+             * the reply callback runs. */
+            res->value = o ? RedisModule_CreateStringFromString(NULL, o->value) : NULL;
+            res->version = o ? o->version : 0;
+            RedisModuleBlockedClient *bc = w->bc;
+            removeWaiter(w);
+            RedisModule_UnblockClient(bc, res);
         }
+        w = next;
+    }
+}
 
-        RedisModule_SetExpire(key, milliseconds);
-    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
-        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+static void signalKeyWaiters(RedisModuleCtx *ctx, RedisModuleString *keyname, TairStringObj *o) {
+    if (RedisModule_DictSize(TairStringWaitersByKey) == 0) return;
+
+    char buf[256];
+    size_t len;
+    char *ikey = waiterIndexKey(ctx, keyname, buf, sizeof(buf), &len);
+    TairStringWaiterList *list = RedisModule_DictGetC(TairStringWaitersByKey, ikey, len, NULL);
+    if (ikey != buf) RedisModule_Free(ikey);
+    if (list) wakeWaiters(list, o);
+}
+
+/* Wake up every waiter of dbid, or of all dbs if dbid is -1, as if their keys
+ * were deleted. The lists are freed as they empty, so the iteration starts
+ * over after each of them. */
+static void signalDbWaiters(int dbid) {
+    for (;;) {
+        TairStringWaiterList *list = NULL;
+        RedisModuleDictIter *iter = dbid < 0 ? RedisModule_DictIteratorStartC(TairStringWaitersByKey, "^", NULL, 0)
+                                             : RedisModule_DictIteratorStartC(TairStringWaitersByKey, ">=", &dbid,
+                                                                              sizeof(dbid));
+        size_t len;
+        char *ikey = RedisModule_DictNextC(iter, &len, (void **)&list);
+        RedisModule_DictIteratorStop(iter);
+        if (ikey == NULL || (dbid >= 0 && memcmp(ikey, &dbid, sizeof(dbid)) != 0)) break;
+        wakeWaiters(list, NULL);
     }
+}
 
-    /* Rewrite relative value to absolute value. */
-    size_t vlen = 4, VSIZE_MAX = 9;
-    RedisModuleString **v = NULL;
-    v = RedisModule_Calloc(sizeof(RedisModuleString *), VSIZE_MAX);
-    v[0] = RedisModule_CreateStringFromString(ctx, argv[1]);
-    v[1] = RedisModule_CreateStringFromString(ctx, argv[2]);
-    v[2] = RedisModule_CreateString(ctx, "ABS", 3);
-    v[3] = RedisModule_CreateStringFromLongLong(ctx, tair_string_obj->version);
-    if (expire_p) {
-        v[vlen] = RedisModule_CreateString(ctx, "PXAT", 4);
-        v[vlen + 1] = RedisModule_CreateStringFromLongLong(ctx, milliseconds + RedisModule_Milliseconds());
-        vlen += 2;
+static int waitReplyCallback(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    TairStringWaitResult *res = RedisModule_GetBlockedClientPrivateData(ctx);
+    if (res == NULL || res->value == NULL) {
+        return RedisModule_ReplyWithNull(ctx);
     }
-    if (flags_p) {
-        v[vlen] = RedisModule_CreateString(ctx, "FLAGS", 5);
-        v[vlen + 1] = RedisModule_CreateStringFromLongLong(ctx, (long long)tair_string_obj->flags);
-        vlen += 2;
+
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithString(ctx, res->value);
+    RedisModule_ReplyWithLongLong(ctx, res->version);
+    return REDISMODULE_OK;
+}
+
+static int waitTimeoutCallback(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModuleBlockedClient *bc = RedisModule_GetBlockedClientHandle(ctx);
+    TairStringWaiter *w = RedisModule_DictGetC(TairStringWaitersByClient, &bc, sizeof(bc), NULL);
+    if (w) {
+        removeWaiter(w);
+        /* Every blocked client must be unblocked once, or its handle leaks. */
+        RedisModule_UnblockClient(bc, NULL);
     }
-    if (ex_flags&TAIR_STRING_SET_KEEPTTL) {
-        v[vlen++] = RedisModule_CreateString(ctx, "KEEPTTL", 7);
+    return RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_TIMEOUT);
+}
+
+static void waitDisconnectCallback(RedisModuleCtx *ctx, RedisModuleBlockedClient *bc) {
+    TairStringWaiter *w = RedisModule_DictGetC(TairStringWaitersByClient, &bc, sizeof(bc), NULL);
+    if (w) {
+        removeWaiter(w);
+        RedisModule_UnblockClient(bc, NULL);
     }
-    RedisModule_Replicate(ctx, "EXSET", "v", v, vlen);
-    RedisModule_Free(v);
+}
 
-    if (ex_flags & TAIR_STRING_RETURN_WITH_VER) {
-        RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
-    } else {
-        RedisModule_ReplyWithSimpleString(ctx, "OK");
+static void waitFreePrivdata(RedisModuleCtx *ctx, void *privdata) {
+    TairStringWaitResult *res = privdata;
+    if (res->value) RedisModule_FreeString(NULL, res->value);
+    RedisModule_Free(res);
+}
+
+/* Keys may also change or vanish behind our back (DEL, expire, eviction,
+ * RENAME, a plain SET over the key...), so waiters are woken up from keyspace
+ * events as well. */
+static int waitKeyspaceCallback(RedisModuleCtx *ctx, int type, const char *event, RedisModuleString *keyname) {
+    /* A renamed or restored key has to be indexed under its new name. */
+    if (!strcmp(event, "rename_to") || !strcmp(event, "restore")) {
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+        if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) == TairStringType) {
+            TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+            if (o->ext && o->ext->ntags) {
+                tagIndexMove(o, RedisModule_GetSelectedDb(ctx), keyname);
+            }
+        }
+        RedisModule_CloseKey(key);
     }
 
+    if (RedisModule_DictSize(TairStringWaitersByKey) == 0) return REDISMODULE_OK;
+
+    /* The key is still in the keyspace when "expired" and "evicted" fire, it
+     * must not be looked up again from here. */
+    if (!strcmp(event, "del") || !strcmp(event, "expired") || !strcmp(event, "evicted")
+        || !strcmp(event, "rename_from") || !strcmp(event, "move_from")) {
+        signalKeyWaiters(ctx, keyname, NULL);
+        return REDISMODULE_OK;
+    }
+
+    if (type & REDISMODULE_NOTIFY_STRING || !strcmp(event, "rename_to") || !strcmp(event, "restore")) {
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+        int keytype = RedisModule_KeyType(key);
+        if (keytype != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) == TairStringType) {
+            signalKeyWaiters(ctx, keyname, RedisModule_ModuleTypeGetValue(key));
+        } else {
+            signalKeyWaiters(ctx, keyname, NULL);
+        }
+        RedisModule_CloseKey(key);
+    }
     return REDISMODULE_OK;
 }
 
-/* EXGET <key> [WITHFLAGS] */
-int TairStringTypeGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    RedisModule_AutoMemory(ctx);
+/* FLUSHDB, FLUSHALL and SWAPDB fire no keyspace event per key, they are only
+ * seen through server events. That API is newer than the redismodule.h this
+ * module builds against, so the few bits needed are declared here and the
+ * subscription is resolved at load time; older servers just do not get it. */
+#define TAIRSTRING_EVENT_FLUSHDB 2
+#define TAIRSTRING_EVENT_SWAPDB 11
+#define TAIRSTRING_SUBEVENT_FLUSHDB_END 1
 
-    if (argc < 2 || argc > 3) {
-        return RedisModule_WrongArity(ctx);
+typedef struct TairStringServerEvent {
+    uint64_t id;
+    uint64_t dataver;
+} TairStringServerEvent;
+
+typedef struct TairStringFlushInfo {
+    uint64_t version;
+    int32_t sync;
+    int32_t dbnum; /* -1 for FLUSHALL. */
+} TairStringFlushInfo;
+
+typedef struct TairStringSwapDbInfo {
+    uint64_t version;
+    int32_t dbnum_first;
+    int32_t dbnum_second;
+} TairStringSwapDbInfo;
+
+typedef void (*TairStringServerEventCallback)(RedisModuleCtx *ctx, TairStringServerEvent eid, uint64_t subevent,
+                                              void *data);
+
+static int (*TairStringSubscribeToServerEvent)(RedisModuleCtx *ctx, TairStringServerEvent event,
+                                               TairStringServerEventCallback callback);
+
+static void waitServerEventCallback(RedisModuleCtx *ctx, TairStringServerEvent eid, uint64_t subevent, void *data) {
+    REDISMODULE_NOT_USED(ctx);
+    if (RedisModule_DictSize(TairStringWaitersByKey) == 0) return;
+
+    if (eid.id == TAIRSTRING_EVENT_FLUSHDB && subevent == TAIRSTRING_SUBEVENT_FLUSHDB_END) {
+        signalDbWaiters(((TairStringFlushInfo *)data)->dbnum);
+    } else if (eid.id == TAIRSTRING_EVENT_SWAPDB) {
+        TairStringSwapDbInfo *info = data;
+        signalDbWaiters(info->dbnum_first);
+        signalDbWaiters(info->dbnum_second);
     }
+}
 
-    if (argc == 3 && mstringcasecmp(argv[2], "withflags")) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+static void subscribeToServerEvents(RedisModuleCtx *ctx) {
+    if (RedisModule_GetApi("RedisModule_SubscribeToServerEvent", (void **)&TairStringSubscribeToServerEvent)
+        != REDISMODULE_OK) {
+        return;
     }
+    TairStringServerEvent flushdb = {TAIRSTRING_EVENT_FLUSHDB, 1}, swapdb = {TAIRSTRING_EVENT_SWAPDB, 1};
+    TairStringSubscribeToServerEvent(ctx, flushdb, waitServerEventCallback);
+    /* SWAPDB is missing from some servers that have the API, it fails then. */
+    TairStringSubscribeToServerEvent(ctx, swapdb, waitServerEventCallback);
+}
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
-    int type = RedisModule_KeyType(key);
-    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
-        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+/* =============================== change log ================================*/
+
+/* A bounded in-memory log of exstrtype writes that EXCHANGES pages through.
+ * It is disabled unless the module is loaded with "changelog-size <n>". The
+ * first sequence number is derived from the load time, so the sequence keeps
+ * growing across restarts and a caller resuming from a sequence of a previous
+ * run is told to resync instead of silently missing changes. */
+typedef struct TairStringChange {
+    uint64_t seq;
+    uint64_t version;
+    int dbid;
+    const char *op;
+    RedisModuleString *key;
+} TairStringChange;
+
+static struct {
+    TairStringChange *entries;
+    size_t size;  /* Capacity of entries, 0 means disabled. */
+    size_t len;   /* Number of valid entries. */
+    size_t head;  /* Index of the oldest entry. */
+    uint64_t next_seq;
+} TairStringChangeLog;
+
+static void changeLogInit(size_t size) {
+    TairStringChangeLog.size = size;
+    TairStringChangeLog.len = 0;
+    TairStringChangeLog.head = 0;
+    TairStringChangeLog.next_seq = ((uint64_t)RedisModule_Milliseconds() << 16) + 1;
+    TairStringChangeLog.entries = size ? RedisModule_Calloc(size, sizeof(TairStringChange)) : NULL;
+}
+
+static void changeLogAppend(RedisModuleCtx *ctx, RedisModuleString *keyname, const char *op, uint64_t version) {
+    if (TairStringChangeLog.size == 0) return;
+
+    TairStringChange *c;
+    if (TairStringChangeLog.len < TairStringChangeLog.size) {
+        c = &TairStringChangeLog.entries[(TairStringChangeLog.head + TairStringChangeLog.len) % TairStringChangeLog.size];
+        TairStringChangeLog.len++;
+    } else {
+        /* Full, overwrite the oldest entry. */
+        c = &TairStringChangeLog.entries[TairStringChangeLog.head];
+        TairStringChangeLog.head = (TairStringChangeLog.head + 1) % TairStringChangeLog.size;
+        RedisModule_FreeString(NULL, c->key);
     }
 
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithNull(ctx);
-        return REDISMODULE_OK;
+    c->seq = TairStringChangeLog.next_seq++;
+    c->version = version;
+    c->dbid = RedisModule_GetSelectedDb(ctx);
+    c->op = op;
+    c->key = RedisModule_CreateStringFromString(NULL, keyname);
+}
+
+/* ========================= keyspace notifications ==========================*/
+
+/* Set by the "notify-events yes" module argument. */
+static int TairStringNotifyEvents = 0;
+
+/* Newer than the redismodule.h this module builds against, resolved at load
+ * time, NULL on servers that do not have them. */
+static int (*TairStringPublishMessage)(RedisModuleCtx *ctx, RedisModuleString *channel, RedisModuleString *message);
+static int (*TairStringPublishMessageShard)(RedisModuleCtx *ctx, RedisModuleString *channel,
+                                            RedisModuleString *message);
+
+static void resolvePublishApi(void) {
+    if (RedisModule_GetApi("RedisModule_PublishMessage", (void **)&TairStringPublishMessage) != REDISMODULE_OK) {
+        TairStringPublishMessage = NULL;
     }
+    if (RedisModule_GetApi("RedisModule_PublishMessageShard", (void **)&TairStringPublishMessageShard)
+        != REDISMODULE_OK) {
+        TairStringPublishMessageShard = NULL;
+    }
+}
 
-    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
-    if (argc == 2) {
-        RedisModule_ReplyWithArray(ctx, 2);
-        RedisModule_ReplyWithString(ctx, o->value);
-        RedisModule_ReplyWithLongLong(ctx, o->version);
-    } else { /* argc == 3, WITHFLAGS .*/
-        RedisModule_ReplyWithArray(ctx, 3);
-        RedisModule_ReplyWithString(ctx, o->value);
-        RedisModule_ReplyWithLongLong(ctx, o->version);
-        RedisModule_ReplyWithLongLong(ctx, (long long)o->flags);
+/* Must be called by every exstrtype write once the object has been updated,
+ * op is the name of the command and version the new version of the key (or
+ * the deleted one when o is NULL).
+ *
+ * Besides dropping the cached digest, waking up EXWAIT waiters and feeding
+ * the change log, if notify-events is enabled a keyspace event named after op
+ * is fired, and since keyspace events can not carry a payload, "<op>
+ * <version>" is also published to __exstrtype@<db>__:<key> so that
+ * subscribers can drop stale invalidations without reading the key. A plain
+ * PUBLISH is broadcast to every node of a cluster, so in cluster mode the
+ * message goes to the shard channel instead when the server supports it. */
+static void notifyKeyModified(RedisModuleCtx *ctx, RedisModuleString *keyname, const char *op, uint64_t version,
+                              TairStringObj *o) {
+    if (o) o->digest = 0;
+    signalKeyWaiters(ctx, keyname, o);
+    changeLogAppend(ctx, keyname, op, version);
+
+    if (!TairStringNotifyEvents) return;
+
+    /* Only available since Redis 6.0. */
+    if (RedisModule_NotifyKeyspaceEvent) {
+        RedisModule_NotifyKeyspaceEvent(ctx, REDISMODULE_NOTIFY_STRING, op, keyname);
+    }
+
+    size_t keylen;
+    const char *keyptr = RedisModule_StringPtrLen(keyname, &keylen);
+    RedisModuleString *channel =
+        RedisModule_CreateStringPrintf(ctx, "__exstrtype@%d__:", RedisModule_GetSelectedDb(ctx));
+    RedisModule_StringAppendBuffer(ctx, channel, keyptr, keylen);
+    RedisModuleString *message = RedisModule_CreateStringPrintf(ctx, "%s %llu", op, (unsigned long long)version);
+    if (TairStringPublishMessageShard && (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_CLUSTER)) {
+        TairStringPublishMessageShard(ctx, channel, message);
+    } else if (TairStringPublishMessage) {
+        TairStringPublishMessage(ctx, channel, message);
+    } else {
+        RedisModuleCallReply *reply = RedisModule_Call(ctx, "PUBLISH", "ss", channel, message);
+        if (reply) RedisModule_FreeCallReply(reply);
+    }
+    RedisModule_FreeString(ctx, channel);
+    RedisModule_FreeString(ctx, message);
+}
+
+static int parseModuleArgs(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    int j;
+    long long changelog_size = 0;
+    for (j = 0; j < argc; j += 2) {
+        if (!mstringcasecmp(argv[j], "changelog-size") && j + 1 < argc) {
+            if (RedisModule_StringToLongLong(argv[j + 1], &changelog_size) != REDISMODULE_OK || changelog_size < 0) {
+                RedisModule_Log(ctx, "warning", "changelog-size must be a non negative integer");
+                return REDISMODULE_ERR;
+            }
+        } else if (!mstringcasecmp(argv[j], "notify-events") && j + 1 < argc) {
+            if (!mstringcasecmp(argv[j + 1], "yes")) {
+                TairStringNotifyEvents = 1;
+            } else if (!mstringcasecmp(argv[j + 1], "no")) {
+                TairStringNotifyEvents = 0;
+            } else {
+                RedisModule_Log(ctx, "warning", "notify-events must be yes or no");
+                return REDISMODULE_ERR;
+            }
+        } else {
+            RedisModule_Log(ctx, "warning", "Unrecognized module argument: %s",
+                            RedisModule_StringPtrLen(argv[j], NULL));
+            return REDISMODULE_ERR;
+        }
     }
 
+    changeLogInit((size_t)changelog_size);
     return REDISMODULE_OK;
 }
 
-/* EXINCRBY <key> <num> [DEF default_value] [EX/EXAT/PX/PXAT time] [NX/XX]
- * [VER/ABS version] [MIN/MAX maxval] [NONEGATIVE] [WITHVERSION] [KEEPTTL] */
-int TairStringTypeIncrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* Return 1 if key already holds version or a newer one, a missing key being
+ * at version 0. Keys of another type are not stale, the caller still has to
+ * reply with WRONGTYPE. */
+static int isStaleVersion(RedisModuleKey *key, long long version) {
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) return version == 0;
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) return 0;
+
+    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+    return o->version >= (uint64_t)version;
+}
+
+/* With VERGT a write only applies when it carries a version newer than the
+ * one of the key, so that redelivered or reordered events can be applied
+ * blindly. Stale writes are dropped with a short SKIPPED status, and 1 is
+ * returned so that the caller stops there. */
+static int skipStaleVersionWrite(RedisModuleCtx *ctx, RedisModuleKey *key, int ex_flags, long long version) {
+    if (!(ex_flags & TAIR_STRING_SET_WITH_GT_VER) || !isStaleVersion(key, version)) return 0;
+
+    RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_SKIPPED);
+    return 1;
+}
+
+/* ========================= "tairstring" type commands =======================*/
+
+/* EXSET <key> <value> [EX/EXAT/PX/PXAT time] [NX/XX] [VER/ABS version] [FLAGS flags] [WITHVERSION] [KEEPTTL]
+ *       [LEASE token] [SOFTTTL ms GRACE ms] [JITTER pct] [RECOMPUTE ms] [NS nskey] [TAGS count tag [tag ...]]
+ *       [KEEPVERSIONS n] [KEEPFOR ms] */
+int TairStringTypeSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        TairStringExArgs ns_args;
+        int ns_flags;
+        if (parseAndGetExFlags(argv, argc, 3, &ns_flags, &ns_args, ~0u) != REDISMODULE_OK) ns_args.ns = NULL;
+        return declareNamespaceKeys(ctx, argv, argc, ns_args.ns);
+    }
+
     if (argc < 3) {
         return RedisModule_WrongArity(ctx);
     }
 
-    long long min = 0, max = 0, value, incr, defaultvalue = 0; /* If DEF is not set, then defaultvalue = 0 .*/
-    RedisModuleString *min_p = NULL, *max_p = NULL;
-    long long milliseconds = 0, expire = 0, version = 0;
-    RedisModuleString *expire_p = NULL, *version_p = NULL, *defaultvalue_p = NULL;
-
+    long long milliseconds = 0, expire = 0, version = 0, flags = 0, lease = 0, softttl = 0, grace = 0;
+    long long recompute = 0, generation = 0;
+    long long jitter = 0;
+    long long keepversions = 0, keepfor = 0;
+    TairStringExArgs args;
     int ex_flags = TAIR_STRING_SET_NO_FLAGS;
     unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | 
                       TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL | TAIR_STRING_SET_WITH_VER |
-                      TAIR_STRING_SET_WITH_ABS_VER  | TAIR_STRING_RETURN_WITH_VER | TAIR_STRING_SET_WITH_DEF |
-                      TAIR_STRING_SET_NONEGATIVE | TAIR_STRING_SET_WITH_BOUNDARY;
-    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &expire_p, &version_p, NULL, &defaultvalue_p, &min_p, &max_p, allow_flags) != REDISMODULE_OK) {
+                      TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER | TAIR_STRING_SET_WITH_FLAGS | TAIR_STRING_RETURN_WITH_VER |
+                      TAIR_STRING_SET_WITH_LEASE | TAIR_STRING_SET_WITH_SOFTTTL | TAIR_STRING_SET_WITH_GRACE |
+                      TAIR_STRING_SET_WITH_JITTER | TAIR_STRING_SET_WITH_RECOMPUTE | TAIR_STRING_SET_WITH_NS |
+                      TAIR_STRING_SET_WITH_TAGS | TAIR_STRING_SET_WITH_KEEPVERSIONS | TAIR_STRING_SET_WITH_KEEPFOR;
+    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
         RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    if (mstring2jitter(args.jitter, &jitter) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if (RedisModule_StringToLongLong(argv[2], &incr) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+    if ((NULL != args.expire) && (RedisModule_StringToLongLong(args.expire, &expire) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != defaultvalue_p) && (RedisModule_StringToLongLong(defaultvalue_p, &defaultvalue) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+    if ((NULL != args.version) && (RedisModule_StringToLongLong(args.version, &version) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
+    if ((NULL != args.flags) && (RedisModule_StringToLongLong(args.flags, &flags) != REDISMODULE_OK)) {
         RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
+    if ((NULL != args.lease) && (RedisModule_StringToLongLong(args.lease, &lease) != REDISMODULE_OK || lease <= 0)) {
         RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if ((expire_p && expire <=0) || version < 0) {
+    if ((NULL != args.recompute) && (RedisModule_StringToLongLong(args.recompute, &recompute) != REDISMODULE_OK || recompute <= 0)) {
         RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != min_p) && (RedisModule_StringToLongLong(min_p, &min))) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+    if ((args.keepversions && (RedisModule_StringToLongLong(args.keepversions, &keepversions) != REDISMODULE_OK
+                            || keepversions < 0 || keepversions > TAIRSTRING_HISTORY_MAX))
+        || (args.keepfor && (RedisModule_StringToLongLong(args.keepfor, &keepfor) != REDISMODULE_OK || keepfor < 0
+                          || keepfor > LLONG_MAX / 2))) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_HISTORY);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != max_p) && (RedisModule_StringToLongLong(max_p, &max))) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+    if (args.ns && namespaceGeneration(ctx, args.ns, &generation) != REDISMODULE_OK) {
         return REDISMODULE_ERR;
     }
 
-    if (NULL != min_p && NULL != max_p && max < min) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+    /* The hard expire is derived from SOFTTTL and GRACE, which come together. */
+    if ((args.softttl == NULL) != (args.grace == NULL)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+    if (args.softttl
+        && (args.expire || (ex_flags & TAIR_STRING_SET_KEEPTTL)
+            || RedisModule_StringToLongLong(args.softttl, &softttl) != REDISMODULE_OK || softttl <= 0
+            || RedisModule_StringToLongLong(args.grace, &grace) != REDISMODULE_OK || grace <= 0
+            || softttl > LLONG_MAX / 2 || grace > LLONG_MAX / 2)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((args.expire && expire <=0) || version < 0 || flags < 0 || flags > UINT_MAX) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
     TairStringObj *tair_string_obj = NULL;
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (skipStaleVersionWrite(ctx, key, ex_flags, version)) {
+        return REDISMODULE_OK;
+    }
+
+    /* Only the holder of the lease may fill the placeholder, a lease that
+     * expired or was superseded by a write gets nil like a failed NX. */
+    if (args.lease) {
+        if (type == REDISMODULE_KEYTYPE_EMPTY || RedisModule_ModuleTypeGetType(key) != TairStringType
+            || !isLeasePlaceholder(RedisModule_ModuleTypeGetValue(key))
+            || ((TairStringObj *)RedisModule_ModuleTypeGetValue(key))->ext->lease_token != (uint64_t)lease) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    if (REDISMODULE_KEYTYPE_EMPTY == type) {
         if (ex_flags & TAIR_STRING_SET_XX) {
             RedisModule_ReplyWithNull(ctx);
             return REDISMODULE_ERR;
         }
         tair_string_obj = createTairStringTypeObject();
-        value = defaultvalue;
+        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
     } else {
-        if (ex_flags & TAIR_STRING_SET_NX) {
-            RedisModule_ReplyWithNull(ctx);
+        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
             return REDISMODULE_ERR;
         }
-
         tair_string_obj = RedisModule_ModuleTypeGetValue(key);
-        if (RedisModule_StringToLongLong(tair_string_obj->value, &value) != REDISMODULE_OK) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+
+        if (ex_flags & TAIR_STRING_SET_NX) {
+            RedisModule_ReplyWithNull(ctx);
             return REDISMODULE_ERR;
         }
 
+        /* Version 0 means no version checking. */
         if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
             RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
             return REDISMODULE_ERR;
         }
     }
 
-    /* If DEF is set and the key is empty at first, the value won't increase, so
-     * it's unnecessary to check overflow; else the value would increase by
-     * incr, so overflow should be checked. "unnecessary to check overflow" =
-     * "won't return ERR" = "no need to release object".
-     * */
-    if (!(ex_flags & TAIR_STRING_SET_WITH_DEF && type == REDISMODULE_KEYTYPE_EMPTY)) {
-        /* Check overflow. */
-        if ((incr < 0 && value < 0 && incr < (LLONG_MIN - value))
-            || (incr > 0 && value > 0 && incr > (LLONG_MAX - value)) || (max_p != NULL && value + incr > max)
-            || (min_p != NULL && value + incr < min)) {
-            /* If type == EMPTY, then the tair_string_obj is created, so it
-             * should be released here. */
-            if (type == REDISMODULE_KEYTYPE_EMPTY && tair_string_obj) TairStringTypeReleaseObject(tair_string_obj);
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
-            return REDISMODULE_ERR;
-        }
-        value += incr;
+    /* KEEPVERSIONS/KEEPFOR alone keep the other limit of the key. */
+    if (args.keepversions || args.keepfor) {
+        int active = historyActive(tair_string_obj);
+        setHistory(tair_string_obj,
+                   args.keepversions ? (uint32_t)keepversions : (active ? tair_string_obj->ext->keep_versions : 0),
+                   args.keepfor ? keepfor : (active ? tair_string_obj->ext->keep_for : 0));
+    }
+    /* The replaced value moves to the history as is. */
+    if (type != REDISMODULE_KEYTYPE_EMPTY && historyActive(tair_string_obj) && !isLeasePlaceholder(tair_string_obj)) {
+        historyPush(tair_string_obj, tair_string_obj->value);
+        tair_string_obj->value = NULL;
     }
 
-    /* value shouldn't be negative if NONEGATIVE is set; if value is negative,
-     * let value = 0 */
-    if (ex_flags & TAIR_STRING_SET_NONEGATIVE) value = value < 0 ? 0LL : value;
+    if (ex_flags & (TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
+        tair_string_obj->version = version;
+    } else {
+        tair_string_obj->version++;
+    }
+    dropValueState(tair_string_obj);
+    /* Any write fills a lease placeholder and starts a new soft TTL, if any. */
+    if (tair_string_obj->ext) {
+        tair_string_obj->ext->lease_token = 0;
+        tair_string_obj->ext->soft_expire_at = 0;
+        tair_string_obj->ext->recompute_ms = 0;
+        tair_string_obj->ext->ns_stamped = 0;
+    }
 
     if (type != REDISMODULE_KEYTYPE_EMPTY) {
+        /* Free the old value. */
         if (tair_string_obj->value) {
             RedisModule_FreeString(ctx, tair_string_obj->value);
-            tair_string_obj->value = NULL;
         }
-    } else {
-        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
     }
+    tair_string_obj->value = argv[2];
+    /* Reuse the value to avoid memory copies. */
+    RedisModule_RetainString(NULL, argv[2]);
 
-    tair_string_obj->value = RedisModule_CreateStringFromLongLong(NULL, value);
-
-    if (ex_flags & TAIR_STRING_SET_WITH_ABS_VER) {
-        tair_string_obj->version = version;
-    } else {
-        /* If the key doesn't exist and default is set, the version should be 1
-         * although the value won't increase. */
-        tair_string_obj->version++;
+    if (ex_flags & TAIR_STRING_SET_WITH_FLAGS) {
+        tair_string_obj->flags = flags;
     }
 
-    if (expire_p) {
+    if (args.expire) {
         if (ex_flags & TAIR_STRING_SET_EX) {
             expire *= 1000;
         }
         if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
+            /* Since the RedisModule_SetExpire interface can only set relative
+            expiration times, here we first convert the absolute time passed
+            in by the user to relative time. */
             milliseconds = expire - RedisModule_Milliseconds();
             if (milliseconds < 0) {
+                /* Time out now. */
                 milliseconds = 0;
             }
         } else {
             milliseconds = expire;
         }
+        milliseconds = jitterExpire(milliseconds, jitter);
 
+        RedisModule_SetExpire(key, milliseconds);
+    } else if (args.softttl) {
+        milliseconds = softttl + grace;
         RedisModule_SetExpire(key, milliseconds);
     } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
         RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
     }
 
-    if (expire_p) {
-        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version,
-                              "PXAT", (milliseconds + RedisModule_Milliseconds()));
-    } else {
-        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version);
-    }
-
-    if (ex_flags & TAIR_STRING_RETURN_WITH_VER) {
-        RedisModule_ReplyWithArray(ctx, 2);
-        RedisModule_ReplyWithLongLong(ctx, value);
-        RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    /* Rewrite relative value to absolute value. */
+    size_t vlen = 4, VSIZE_MAX = 13;
+    RedisModuleString **v = NULL;
+    v = RedisModule_Calloc(sizeof(RedisModuleString *), VSIZE_MAX);
+    v[0] = RedisModule_CreateStringFromString(ctx, argv[1]);
+    v[1] = RedisModule_CreateStringFromString(ctx, argv[2]);
+    v[2] = RedisModule_CreateString(ctx, "ABS", 3);
+    v[3] = RedisModule_CreateStringFromLongLong(ctx, tair_string_obj->version);
+    if (args.expire || args.softttl) {
+        v[vlen] = RedisModule_CreateString(ctx, "PXAT", 4);
+        v[vlen + 1] = RedisModule_CreateStringFromLongLong(ctx, milliseconds + RedisModule_Milliseconds());
+        vlen += 2;
+    }
+    if (args.flags) {
+        v[vlen] = RedisModule_CreateString(ctx, "FLAGS", 5);
+        v[vlen + 1] = RedisModule_CreateStringFromLongLong(ctx, (long long)tair_string_obj->flags);
+        vlen += 2;
+    }
+    if (ex_flags&TAIR_STRING_SET_KEEPTTL) {
+        v[vlen++] = RedisModule_CreateString(ctx, "KEEPTTL", 7);
+    }
+    if (args.keepversions) {
+        v[vlen] = RedisModule_CreateString(ctx, "KEEPVERSIONS", 12);
+        v[vlen + 1] = RedisModule_CreateStringFromLongLong(ctx, keepversions);
+        vlen += 2;
+    }
+    if (args.keepfor) {
+        v[vlen] = RedisModule_CreateString(ctx, "KEEPFOR", 7);
+        v[vlen + 1] = RedisModule_CreateStringFromLongLong(ctx, keepfor);
+        vlen += 2;
+    }
+    RedisModule_Replicate(ctx, "EXSET", "v", v, vlen);
+    RedisModule_Free(v);
+
+    if (args.softttl) {
+        setSoftTTL(tair_string_obj, RedisModule_Milliseconds() + softttl);
+        RedisModule_Replicate(ctx, "EXSOFTSET", "sl", argv[1], tair_string_obj->ext->soft_expire_at);
+    }
+    if (args.recompute) {
+        setRecompute(tair_string_obj, recompute);
+        RedisModule_Replicate(ctx, "EXRECOMPUTESET", "sl", argv[1], recompute);
+    }
+    if (args.ns) {
+        setNamespace(tair_string_obj, generation);
+        RedisModule_Replicate(ctx, "EXNSSET", "sl", argv[1], generation);
+    }
+    if (args.tags) {
+        long long ntags;
+        RedisModule_StringToLongLong(args.tags[0], &ntags);
+        setTags(tair_string_obj, RedisModule_GetSelectedDb(ctx), argv[1], args.tags + 1, (uint32_t)ntags);
+        RedisModule_Replicate(ctx, "EXTAGSET", "sv", argv[1], args.tags + 1, (size_t)ntags);
     } else {
-        RedisModule_ReplyWithLongLong(ctx, value);
+        setTags(tair_string_obj, RedisModule_GetSelectedDb(ctx), argv[1], NULL, 0);
+    }
+
+    notifyKeyModified(ctx, argv[1], "exset", tair_string_obj->version, tair_string_obj);
+
+    if (ex_flags & TAIR_STRING_RETURN_WITH_VER) {
+        RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    } else {
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
     }
+
     return REDISMODULE_OK;
 }
 
-/* EXINCRBYFLOAT <key> <num> [MIN/MAX maxval] [EX/EXAT/PX/PXAT time] [NX/XX] [VER/ABS version] [KEEPTTL] */
-int TairStringTypeIncrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    RedisModule_AutoMemory(ctx);
+/* Reply with the value and version of o, followed by the flags and the digest
+ * if requested in with. If the caller already holds known_version, only a
+ * short NOT_MODIFIED status is sent so that an unchanged value is never
+ * shipped again. A known_version of -1 disables the check. */
+static void replyWithTairStringObj(RedisModuleCtx *ctx, TairStringObj *o, int with, long long known_version) {
+    /* Past its soft TTL the value is still served with a trailing STALE, or
+     * REFRESH for the first such reader, who is expected to rewrite it. The
+     * marker is node local, it is not replicated. */
+    const char *stale = NULL;
+    if (softTTLActive(o) && RedisModule_Milliseconds() >= o->ext->soft_expire_at) {
+        stale = o->ext->soft_refreshing ? TAIRSTRING_STATUSMSG_STALE : TAIRSTRING_STATUSMSG_REFRESH;
+        o->ext->soft_refreshing = 1;
+    } else if (with & TAIRSTRING_REPLY_REFRESH) {
+        stale = TAIRSTRING_STATUSMSG_REFRESH;
+    }
 
-    if (argc < 3) {
-        return RedisModule_WrongArity(ctx);
+    if (known_version >= 0 && (uint64_t)known_version == o->version && stale == NULL) {
+        RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_NOT_MODIFIED);
+        return;
     }
 
-    long double min = 0, max = 0, value, oldvalue, incr;
-    RedisModuleString *min_p = NULL, *max_p = NULL;
-    long long milliseconds = 0, expire = 0, version = 0;
-    RedisModuleString *expire_p = NULL, *version_p = NULL;
+    RedisModule_ReplyWithArray(ctx, 2 + !!(with & TAIRSTRING_REPLY_WITH_FLAGS) + !!(with & TAIRSTRING_REPLY_WITH_DIGEST)
+                                        + (stale != NULL));
+    long double value;
+    if (decayActive(o) && mstring2ld(o->value, &value) == REDISMODULE_OK) {
+        /* Decaying counters are read as of now. */
+        char dbuf[MAX_LONG_DOUBLE_CHARS];
+        int dlen = m_ld2string(dbuf, sizeof(dbuf), decayValue(o, value, RedisModule_Milliseconds()), 1);
+        RedisModule_ReplyWithStringBuffer(ctx, dbuf, dlen);
+    } else {
+        RedisModule_ReplyWithString(ctx, o->value);
+    }
+    RedisModule_ReplyWithLongLong(ctx, o->version);
+    if (with & TAIRSTRING_REPLY_WITH_FLAGS) {
+        RedisModule_ReplyWithLongLong(ctx, (long long)o->flags);
+    }
+    if (with & TAIRSTRING_REPLY_WITH_DIGEST) {
+        replyWithDigest(ctx, tairStringObjDigest(o));
+    }
+    if (stale) {
+        RedisModule_ReplyWithSimpleString(ctx, stale);
+    }
+}
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+/* Reply to a read of key, shared by EXGET and its multi-key forms. If the
+ * key is older than min_version (e.g. a lagging replica) only a short STALE
+ * status is sent, so the caller can retry on the master. A min_version of 0
+ * disables the check. */
+static void replyWithTairStringKey(RedisModuleCtx *ctx, RedisModuleKey *key, int with, long long known_version,
+                                   long long min_version) {
     int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-        return REDISMODULE_ERR;
+        return;
     }
 
-    if (mstring2ld(argv[2], &incr) == REDISMODULE_ERR) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_FLOAT);
-        return REDISMODULE_ERR;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        /* The caller knows of a version this node has not seen yet. */
+        if (min_version > 0) {
+            RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_STALE);
+        } else {
+            RedisModule_ReplyWithNull(ctx);
+        }
+        return;
     }
 
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | 
-                      TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL | TAIR_STRING_SET_WITH_VER |
-                      TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_BOUNDARY;
-    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &expire_p, &version_p, NULL, NULL, &min_p, &max_p, allow_flags) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+    if (isLeasePlaceholder(o)) {
+        RedisModule_ReplyWithNull(ctx);
+        return;
+    }
+    if (o->version < (uint64_t)min_version) {
+        RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_STALE);
+        return;
     }
 
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    if (earlyRefresh(key, o)) with |= TAIRSTRING_REPLY_REFRESH;
+    replyWithTairStringObj(ctx, o, with, known_version);
+}
+
+/* EXGET ... VERSION <version>: a snapshot read of version, which is either
+ * the current version of key or one kept in its history. Anything else is a
+ * miss. */
+static void replyWithTairStringVersion(RedisModuleCtx *ctx, RedisModuleKey *key, int with, uint64_t version) {
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) == TairStringType) {
+        TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+        if (o->version != version) {
+            TairStringVersion *v = isLeasePlaceholder(o) ? NULL : historyLookup(o, version);
+            if (v == NULL) {
+                RedisModule_ReplyWithNull(ctx);
+                return;
+            }
+            TairStringObj snapshot = {v->version, v->flags, v->value, 0, NULL};
+            replyWithTairStringObj(ctx, &snapshot, with, -1);
+            return;
+        }
     }
+    replyWithTairStringKey(ctx, key, with, -1, 0);
+}
 
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+/* EXLEASE: on a miss the first caller gets a lease token to fill the key with
+ * EXSET ... LEASE, and a placeholder holding it for ttl ms. The next callers
+ * are parked until the key is filled, or get nil once the lease expired so
+ * that one of them takes it over, so N concurrent misses only cause one
+ * backend fetch. */
+static void replyWithLease(RedisModuleCtx *ctx, RedisModuleString *keyname, int with, long long ttl) {
+    /* Tokens are handed out by the master, even a writable replica must not
+     * create placeholders. */
+    if (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_SLAVE) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_LEASE_REPLICA);
+        return;
     }
 
-    if ((expire_p && expire <=0) || version < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return;
     }
 
-    if ((NULL != min_p) && (mstring2ld(min_p, &min) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
-        return REDISMODULE_ERR;
+    if (type != REDISMODULE_KEYTYPE_EMPTY) {
+        TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+        if (!isLeasePlaceholder(o)) {
+            if (earlyRefresh(key, o)) with |= TAIRSTRING_REPLY_REFRESH;
+            replyWithTairStringObj(ctx, o, with, -1);
+            return;
+        }
+
+        /* Someone else is filling the key. Blocking is not possible inside
+         * MULTI or scripts, see EXWAIT. */
+        if (RedisModule_GetContextFlags(ctx) & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA)) {
+            RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_TIMEOUT);
+            return;
+        }
+        RedisModuleBlockedClient *bc =
+            RedisModule_BlockClient(ctx, waitReplyCallback, waitTimeoutCallback, waitFreePrivdata, ttl);
+        RedisModule_SetDisconnectCallback(bc, waitDisconnectCallback);
+        addWaiter(ctx, keyname, bc, 0);
+        return;
     }
 
-    if ((NULL != max_p) && (mstring2ld(max_p, &max) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
-        return REDISMODULE_ERR;
+    TairStringObj *o = createTairStringTypeObject();
+    o->value = RedisModule_CreateString(NULL, "", 0);
+    tairStringObjExt(o)->lease_token = TairStringLeaseNext++;
+    RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    RedisModule_SetExpire(key, ttl);
+
+    RedisModule_Replicate(ctx, "EXLEASESET", "sll", keyname, (long long)o->ext->lease_token,
+                          RedisModule_Milliseconds() + ttl);
+    notifyKeyModified(ctx, keyname, "exlease", o->version, o);
+
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithNull(ctx);
+    RedisModule_ReplyWithLongLong(ctx, (long long)o->ext->lease_token);
+}
+
+/* EXGET/EXLEASE ... NS <nskey>: an entry stamped with an older generation of
+ * its namespace is a miss. EXGET leaves it in place, a read must not write,
+ * it goes away with its TTL or the next write of the key. Returns 1 if the
+ * entry is stale, 0 if not and -1 after replying with an error. */
+static int namespaceStale(RedisModuleCtx *ctx, RedisModuleString *keyname, RedisModuleString *nskey) {
+    long long generation;
+    if (namespaceGeneration(ctx, nskey, &generation) != REDISMODULE_OK) {
+        return -1;
     }
 
-    if (NULL != min_p && NULL != max_p && max < min) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
-        return REDISMODULE_ERR;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY || RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        return 0;
     }
+    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+    return nsActive(o) && o->ext->ns_generation != generation;
+}
 
-    TairStringObj *tair_string_obj = NULL;
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        if (ex_flags & TAIR_STRING_SET_XX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
-        tair_string_obj = createTairStringTypeObject();
-        value = 0;
-    } else {
-        if (ex_flags & TAIR_STRING_SET_NX) {
-            RedisModule_ReplyWithNull(ctx);
+/* EXGET <key> [WITHFLAGS] [WITHDIGEST] [IFNEWER version] [MINVERSION version] [NS nskey]
+ *       [VERSION version] */
+int TairStringTypeGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        return declareNamespaceKeys(ctx, argv, argc, scanNamespaceKey(argv, argc, 2));
+    }
+
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    int j, with = 0;
+    long long known_version = -1, min_version = 0, snapshot_version = 0;
+    RedisModuleString *ifnewer_p = NULL, *minversion_p = NULL, *ns_p = NULL, *version_p = NULL;
+    for (j = 2; j < argc; j++) {
+        if (!(with & TAIRSTRING_REPLY_WITH_FLAGS) && !mstringcasecmp(argv[j], "withflags")) {
+            with |= TAIRSTRING_REPLY_WITH_FLAGS;
+        } else if (!(with & TAIRSTRING_REPLY_WITH_DIGEST) && !mstringcasecmp(argv[j], "withdigest")) {
+            with |= TAIRSTRING_REPLY_WITH_DIGEST;
+        } else if (ifnewer_p == NULL && !mstringcasecmp(argv[j], "ifnewer") && j + 1 < argc) {
+            ifnewer_p = argv[++j];
+        } else if (minversion_p == NULL && !mstringcasecmp(argv[j], "minversion") && j + 1 < argc) {
+            minversion_p = argv[++j];
+        } else if (ns_p == NULL && !mstringcasecmp(argv[j], "ns") && j + 1 < argc) {
+            ns_p = argv[++j];
+        } else if (version_p == NULL && !mstringcasecmp(argv[j], "version") && j + 1 < argc) {
+            version_p = argv[++j];
+        } else {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
             return REDISMODULE_ERR;
         }
+    }
 
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
-        if (mstring2ld(tair_string_obj->value, &value) != REDISMODULE_OK) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_FLOAT);
+    if (ifnewer_p && (RedisModule_StringToLongLong(ifnewer_p, &known_version) != REDISMODULE_OK || known_version < 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
+        return REDISMODULE_ERR;
+    }
+
+    if (minversion_p && (RedisModule_StringToLongLong(minversion_p, &min_version) != REDISMODULE_OK || min_version < 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
+        return REDISMODULE_ERR;
+    }
+
+    if (version_p) {
+        if (RedisModule_StringToLongLong(version_p, &snapshot_version) != REDISMODULE_OK || snapshot_version <= 0) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
             return REDISMODULE_ERR;
         }
-
-        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
+        if (ifnewer_p || minversion_p) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
             return REDISMODULE_ERR;
         }
     }
 
-    oldvalue = value;
-
-    if (isnan(oldvalue + incr) || isinf(oldvalue + incr) || (max_p != NULL && oldvalue + incr > max)
-        || (min_p != NULL && oldvalue + incr < min)) {
-        if (type == REDISMODULE_KEYTYPE_EMPTY && tair_string_obj) TairStringTypeReleaseObject(tair_string_obj);
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
-        return REDISMODULE_ERR;
+    if (ns_p) {
+        int stale = namespaceStale(ctx, argv[1], ns_p);
+        if (stale < 0) {
+            return REDISMODULE_ERR;
+        } else if (stale) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        }
     }
 
-    if (ex_flags & TAIR_STRING_SET_WITH_ABS_VER) {
-        tair_string_obj->version = version;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (version_p) {
+        replyWithTairStringVersion(ctx, key, with, (uint64_t)snapshot_version);
     } else {
-        tair_string_obj->version++;
+        replyWithTairStringKey(ctx, key, with, known_version, min_version);
     }
+    return REDISMODULE_OK;
+}
 
-    value += incr;
+/* EXLEASE <key> <ttl> [WITHFLAGS] [WITHDIGEST] [NS nskey]
+ *
+ * EXGET for cache fills, a write command since a miss creates the lease
+ * placeholder. */
+int TairStringTypeExLease_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
 
-    char dbuf[MAX_LONG_DOUBLE_CHARS];
-    int dlen = m_ld2string(dbuf, sizeof(dbuf), value, 1);
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        return declareNamespaceKeys(ctx, argv, argc, scanNamespaceKey(argv, argc, 3));
+    }
 
-    if (type != REDISMODULE_KEYTYPE_EMPTY) {
-        if (tair_string_obj->value) {
-            RedisModule_FreeString(ctx, tair_string_obj->value);
-            tair_string_obj->value = NULL;
-        }
-    } else {
-        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
     }
-    tair_string_obj->value = RedisModule_CreateString(NULL, dbuf, dlen);
 
-    if (expire_p) {
-        if (ex_flags & TAIR_STRING_SET_EX) {
-            expire *= 1000;
-        }
-        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
-            milliseconds = expire - RedisModule_Milliseconds();
-            if (milliseconds < 0) {
-                milliseconds = 0;
-            }
+    int j, with = 0;
+    long long ttl;
+    RedisModuleString *ns_p = NULL;
+    for (j = 3; j < argc; j++) {
+        if (!(with & TAIRSTRING_REPLY_WITH_FLAGS) && !mstringcasecmp(argv[j], "withflags")) {
+            with |= TAIRSTRING_REPLY_WITH_FLAGS;
+        } else if (!(with & TAIRSTRING_REPLY_WITH_DIGEST) && !mstringcasecmp(argv[j], "withdigest")) {
+            with |= TAIRSTRING_REPLY_WITH_DIGEST;
+        } else if (ns_p == NULL && !mstringcasecmp(argv[j], "ns") && j + 1 < argc) {
+            ns_p = argv[++j];
         } else {
-            milliseconds = expire;
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
         }
+    }
 
-        RedisModule_SetExpire(key, milliseconds);
-    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
-        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    if (RedisModule_StringToLongLong(argv[2], &ttl) != REDISMODULE_OK || ttl <= 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
     }
 
-    if (expire_p) {
-        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version,
-                              "PXAT", (milliseconds + RedisModule_Milliseconds()));
-    } else {
-        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version);
+    if (ns_p) {
+        int stale = namespaceStale(ctx, argv[1], ns_p);
+        if (stale < 0) {
+            return REDISMODULE_ERR;
+        } else if (stale && !(RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_SLAVE)) {
+            /* EXLEASE is a write, the stale entry makes room for the lease. */
+            RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+            uint64_t version = ((TairStringObj *)RedisModule_ModuleTypeGetValue(key))->version;
+            RedisModule_DeleteKey(key);
+            RedisModule_Replicate(ctx, "DEL", "s", argv[1]);
+            notifyKeyModified(ctx, argv[1], "exnsdel", version, NULL);
+        }
     }
 
-    RedisModule_ReplyWithString(ctx, tair_string_obj->value);
+    replyWithLease(ctx, argv[1], with, ttl);
     return REDISMODULE_OK;
 }
 
-/* EXSETVER <key> <version> */
-int TairStringTypeExSetVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXLEASESET <key> <token> <expire_at>
+ *
+ * Make key a lease placeholder, this is what EXLEASE replicates and
+ * what the AOF rewrite emits, it is not meant to be called by clients. */
+int TairStringTypeExLeaseSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc != 3) {
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 4) {
         return RedisModule_WrongArity(ctx);
     }
 
-    long long version = 0;
+    long long token, expire_at;
+    if (RedisModule_StringToLongLong(argv[2], &token) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[3], &expire_at) != REDISMODULE_OK || token <= 0 || expire_at < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
 
+    /* The AOF rewrite emits an EXSET of the empty value at version 0 first. */
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
     int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
         return REDISMODULE_ERR;
     }
 
-    TairStringObj *tair_string_obj = NULL;
+    TairStringObj *o = NULL;
     if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithLongLong(ctx, 0);
-        return REDISMODULE_OK;
+        o = createTairStringTypeObject();
+        o->value = RedisModule_CreateString(NULL, "", 0);
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
     } else {
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+        o = RedisModule_ModuleTypeGetValue(key);
+        if (o->version != 0) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        }
     }
 
-    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    tairStringObjExt(o)->lease_token = (uint64_t)token;
+    if (expire_at) {
+        long long ttl = expire_at - RedisModule_Milliseconds();
+        RedisModule_SetExpire(key, ttl > 0 ? ttl : 0);
     }
+    /* A promoted replica must not hand out tokens that were already used. */
+    if ((uint64_t)token >= TairStringLeaseNext) TairStringLeaseNext = (uint64_t)token + 1;
 
-    if (version <= 0) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    RedisModule_ReplicateVerbatim(ctx);
+    notifyKeyModified(ctx, argv[1], "exleaseset", o->version, o);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* Shared by EXGETIFNEWER and EXGETMINVERSION: argv holds key/version pairs
+ * and the version is either the one known by the caller (ifnewer) or the
+ * minimum acceptable one. */
+static int getKeyVersionPairs(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int ifnewer) {
+    if (argc < 3 || (argc - 1) % 2 != 0) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    int j;
+    long long version;
+    /* Validate all the versions first, so that a bad argument never leaves a
+     * half written reply behind. */
+    for (j = 2; j < argc; j += 2) {
+        if (RedisModule_StringToLongLong(argv[j], &version) != REDISMODULE_OK || version < 0) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    RedisModule_ReplyWithArray(ctx, (argc - 1) / 2);
+    for (j = 1; j < argc; j += 2) {
+        RedisModule_StringToLongLong(argv[j + 1], &version);
+
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[j], REDISMODULE_READ);
+        if (ifnewer) {
+            replyWithTairStringKey(ctx, key, 0, version, 0);
+        } else {
+            replyWithTairStringKey(ctx, key, 0, -1, version);
+        }
+        RedisModule_CloseKey(key);
     }
 
-    RedisModule_ReplicateVerbatim(ctx);
-    tair_string_obj->version = version;
-    RedisModule_ReplyWithLongLong(ctx, 1);
     return REDISMODULE_OK;
 }
 
-/* EXCAS <key> <new_value> <version> [EX/EXAT/PX/PXAT time] [KEEPTTL] */
-int TairStringTypeExCas_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXGETIFNEWER <key> <version> [<key> <version> ...] */
+int TairStringTypeGetIfNewer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
+    return getKeyVersionPairs(ctx, argv, argc, 1);
+}
 
-    if (argc < 4) {
+/* EXGETMINVERSION <key> <version> [<key> <version> ...] */
+int TairStringTypeGetMinVersion_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    return getKeyVersionPairs(ctx, argv, argc, 0);
+}
+
+/* EXMETA <key> [<key> ...] */
+int TairStringTypeMeta_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 2) {
         return RedisModule_WrongArity(ctx);
     }
 
-    long long version = 0;
-    long long milliseconds = 0, expire = 0;
-    RedisModuleString *expire_p = NULL;
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL;
-    if (parseAndGetExFlags(argv, argc, 4, &ex_flags, &expire_p, NULL, NULL, NULL, NULL, NULL, allow_flags) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    int j;
+    RedisModule_ReplyWithArray(ctx, argc - 1);
+    for (j = 1; j < argc; j++) {
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[j], REDISMODULE_READ);
+        int type = RedisModule_KeyType(key);
+        if (type == REDISMODULE_KEYTYPE_EMPTY) {
+            RedisModule_ReplyWithNull(ctx);
+        } else if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        } else if (isLeasePlaceholder(RedisModule_ModuleTypeGetValue(key))) {
+            /* Missing, as for EXGET. */
+            RedisModule_ReplyWithNull(ctx);
+        } else {
+            TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+            /* Only the length is needed, the value itself is never copied
+             * into the reply. */
+            size_t len;
+            RedisModule_StringPtrLen(o->value, &len);
+            mstime_t pttl = RedisModule_GetExpire(key);
+
+            RedisModule_ReplyWithArray(ctx, 4);
+            RedisModule_ReplyWithLongLong(ctx, o->version);
+            RedisModule_ReplyWithLongLong(ctx, (long long)o->flags);
+            RedisModule_ReplyWithLongLong(ctx, pttl == REDISMODULE_NO_EXPIRE ? -1 : pttl);
+            RedisModule_ReplyWithLongLong(ctx, (long long)len);
+        }
+        RedisModule_CloseKey(key);
     }
 
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    return REDISMODULE_OK;
+}
+
+/* Reply to EXINCRBY ... RESERVE, end being the counter once advanced past all
+ * the segments: a flat [start, end, start, end, ...] array, followed by the
+ * version if requested. */
+static void replyWithReservedSegments(RedisModuleCtx *ctx, long long end, long long size, long long segments,
+                                      int withversion, uint64_t version) {
+    long long j, start = end - size * segments + 1;
+    RedisModule_ReplyWithArray(ctx, segments * 2 + (withversion ? 1 : 0));
+    for (j = 0; j < segments; j++) {
+        RedisModule_ReplyWithLongLong(ctx, start + j * size);
+        RedisModule_ReplyWithLongLong(ctx, start + (j + 1) * size - 1);
+    }
+    if (withversion) {
+        RedisModule_ReplyWithLongLong(ctx, (long long)version);
+    }
+}
+
+/* EXINCRBY <key> <num> [DEF default_value] [EX/EXAT/PX/PXAT time] [NX/XX]
+ * [VER/ABS/VERGT version] [MIN/MAX maxval] [NONEGATIVE] [WITHVERSION] [KEEPTTL]
+ * [REQID id [DEDUPWINDOW ms]] [RESERVE segments] */
+int TairStringTypeIncrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long min = 0, max = 0, value, incr, defaultvalue = 0; /* If DEF is not set, then defaultvalue = 0 .*/
+    long long milliseconds = 0, expire = 0, version = 0, window = TAIRSTRING_REQID_WINDOW_DEFAULT;
+    long long size = 0, segments = 0;
+
+    long long jitter = 0;
+    TairStringExArgs args;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | 
+                      TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL | TAIR_STRING_SET_WITH_VER |
+                      TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER | TAIR_STRING_RETURN_WITH_VER | TAIR_STRING_SET_WITH_DEF |
+                      TAIR_STRING_SET_NONEGATIVE | TAIR_STRING_SET_WITH_BOUNDARY | TAIR_STRING_SET_WITH_REQID |
+                      TAIR_STRING_SET_WITH_RESERVE | TAIR_STRING_SET_WITH_JITTER;
+    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (mstring2jitter(args.jitter, &jitter) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_StringToLongLong(argv[2], &incr) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+        return REDISMODULE_ERR;
+    }
+
+    /* RESERVE hands out the next segments of incr ids each, the counter
+     * being advanced past all of them at once. */
+    if (args.reserve) {
+        if (RedisModule_StringToLongLong(args.reserve, &segments) != REDISMODULE_OK || segments < 1
+            || segments > TAIRSTRING_RESERVE_MAX_SEGMENTS || incr <= 0
+            || (ex_flags & (TAIR_STRING_SET_WITH_DEF | TAIR_STRING_SET_NONEGATIVE))) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_RESERVE);
+            return REDISMODULE_ERR;
+        }
+        if (incr > LLONG_MAX / segments) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+            return REDISMODULE_ERR;
+        }
+        size = incr;
+        incr = size * segments;
+    }
+
+    if ((NULL != args.defaultvalue) && (RedisModule_StringToLongLong(args.defaultvalue, &defaultvalue) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.expire) && (RedisModule_StringToLongLong(args.expire, &expire) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.version) && (RedisModule_StringToLongLong(args.version, &version) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((args.expire && expire <=0) || version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.min) && (RedisModule_StringToLongLong(args.min, &min))) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.max) && (RedisModule_StringToLongLong(args.max, &max))) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (NULL != args.min && NULL != args.max && max < min) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.window) && (RedisModule_StringToLongLong(args.window, &window) != REDISMODULE_OK || window <= 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    /* A retried request gets the result of the first attempt back, without
+     * applying incr again. */
+    if (args.reqid && type != REDISMODULE_KEYTYPE_EMPTY) {
+        TairStringReqId *r = lookupReqId(RedisModule_ModuleTypeGetValue(key), args.reqid, RedisModule_Milliseconds());
+        if (r && (r->size != (args.reserve ? size : incr) || r->segments != (uint32_t)segments)) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_REQID);
+            return REDISMODULE_ERR;
+        } else if (r && args.reserve) {
+            replyWithReservedSegments(ctx, r->value, r->size, r->segments, ex_flags & TAIR_STRING_RETURN_WITH_VER,
+                                      r->version);
+            return REDISMODULE_OK;
+        } else if (r) {
+            if (ex_flags & TAIR_STRING_RETURN_WITH_VER) {
+                RedisModule_ReplyWithArray(ctx, 2);
+                RedisModule_ReplyWithLongLong(ctx, r->value);
+                RedisModule_ReplyWithLongLong(ctx, (long long)r->version);
+            } else {
+                RedisModule_ReplyWithLongLong(ctx, r->value);
+            }
+            return REDISMODULE_OK;
+        }
+    }
+
+    if (skipStaleVersionWrite(ctx, key, ex_flags, version)) {
+        return REDISMODULE_OK;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        if (ex_flags & TAIR_STRING_SET_XX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+        tair_string_obj = createTairStringTypeObject();
+        value = defaultvalue;
+    } else {
+        if (ex_flags & TAIR_STRING_SET_NX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+        /* A lease placeholder holds no number yet, it counts from 0. */
+        if (isLeasePlaceholder(tair_string_obj)) {
+            value = 0;
+        } else if (RedisModule_StringToLongLong(tair_string_obj->value, &value) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+            return REDISMODULE_ERR;
+        }
+
+        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    /* If DEF is set and the key is empty at first, the value won't increase, so
+     * it's unnecessary to check overflow; else the value would increase by
+     * incr, so overflow should be checked. "unnecessary to check overflow" =
+     * "won't return ERR" = "no need to release object".
+     * */
+    if (!(ex_flags & TAIR_STRING_SET_WITH_DEF && type == REDISMODULE_KEYTYPE_EMPTY)) {
+        /* Check overflow. */
+        if ((incr < 0 && value < 0 && incr < (LLONG_MIN - value))
+            || (incr > 0 && value > 0 && incr > (LLONG_MAX - value)) || (args.max != NULL && value + incr > max)
+            || (args.min != NULL && value + incr < min)) {
+            /* If type == EMPTY, then the tair_string_obj is created, so it
+             * should be released here. */
+            if (type == REDISMODULE_KEYTYPE_EMPTY && tair_string_obj) TairStringTypeReleaseObject(tair_string_obj);
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+            return REDISMODULE_ERR;
+        }
+        value += incr;
+    }
+
+    /* value shouldn't be negative if NONEGATIVE is set; if value is negative,
+     * let value = 0 */
+    if (ex_flags & TAIR_STRING_SET_NONEGATIVE) value = value < 0 ? 0LL : value;
+
+    if (type != REDISMODULE_KEYTYPE_EMPTY) {
+        historyRecord(tair_string_obj);
+        dropSpecialState(tair_string_obj);
+        if (tair_string_obj->value) {
+            RedisModule_FreeString(ctx, tair_string_obj->value);
+            tair_string_obj->value = NULL;
+        }
+    } else {
+        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
+    }
+
+    tair_string_obj->value = RedisModule_CreateStringFromLongLong(NULL, value);
+
+    if (ex_flags & (TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
+        tair_string_obj->version = version;
+    } else {
+        /* If the key doesn't exist and default is set, the version should be 1
+         * although the value won't increase. */
+        tair_string_obj->version++;
+    }
+
+    if (args.expire) {
+        if (ex_flags & TAIR_STRING_SET_EX) {
+            expire *= 1000;
+        }
+        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
+            milliseconds = expire - RedisModule_Milliseconds();
+            if (milliseconds < 0) {
+                milliseconds = 0;
+            }
+        } else {
+            milliseconds = expire;
+        }
+        milliseconds = jitterExpire(milliseconds, jitter);
+
+        RedisModule_SetExpire(key, milliseconds);
+    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
+        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    }
+
+    if (args.expire) {
+        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version,
+                              "PXAT", (milliseconds + RedisModule_Milliseconds()));
+    } else {
+        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version);
+    }
+    replicateTags(ctx, argv[1], tair_string_obj);
+
+    /* The request id is replicated with an absolute deadline, so that a
+     * promoted replica keeps deduplicating the same requests. */
+    if (args.reqid) {
+        long long expire_at = RedisModule_Milliseconds() + window, reqid_size = args.reserve ? size : incr;
+        addReqId(tair_string_obj, args.reqid, value, tair_string_obj->version, expire_at, reqid_size, (uint32_t)segments);
+        RedisModule_Replicate(ctx, "EXREQIDSET", "sslllll", argv[1], args.reqid, value, (long long)tair_string_obj->version,
+                              expire_at, reqid_size, segments);
+    }
+
+    notifyKeyModified(ctx, argv[1], "exincrby", tair_string_obj->version, tair_string_obj);
+
+    if (args.reserve) {
+        replyWithReservedSegments(ctx, value, size, segments, ex_flags & TAIR_STRING_RETURN_WITH_VER,
+                                  tair_string_obj->version);
+    } else if (ex_flags & TAIR_STRING_RETURN_WITH_VER) {
+        RedisModule_ReplyWithArray(ctx, 2);
+        RedisModule_ReplyWithLongLong(ctx, value);
+        RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    } else {
+        RedisModule_ReplyWithLongLong(ctx, value);
+    }
+    return REDISMODULE_OK;
+}
+
+/* EXINCRBYFLOAT <key> <num> [MIN/MAX maxval] [EX/EXAT/PX/PXAT time] [NX/XX] [VER/ABS version] [KEEPTTL]
+ *               [HALFLIFE halflife]
+ *
+ * With HALFLIFE the value decays, see decayActive(): the current value is
+ * brought up to date before adding num, and reads see it decayed as of now. */
+int TairStringTypeIncrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long double min = 0, max = 0, value, oldvalue, incr;
+    long long now = RedisModule_Milliseconds();
+    long long milliseconds = 0, expire = 0, version = 0, halflife = 0;
+    TairStringExArgs args;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (mstring2ld(argv[2], &incr) == REDISMODULE_ERR) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_FLOAT);
+        return REDISMODULE_ERR;
+    }
+
+    long long jitter = 0;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | 
+                      TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL | TAIR_STRING_SET_WITH_VER |
+                      TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER | TAIR_STRING_SET_WITH_BOUNDARY |
+                      TAIR_STRING_SET_WITH_HALFLIFE | TAIR_STRING_SET_WITH_JITTER;
+    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (mstring2jitter(args.jitter, &jitter) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (args.halflife && (RedisModule_StringToLongLong(args.halflife, &halflife) != REDISMODULE_OK || halflife <= 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.expire) && (RedisModule_StringToLongLong(args.expire, &expire) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.version) && (RedisModule_StringToLongLong(args.version, &version) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((args.expire && expire <=0) || version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.min) && (mstring2ld(args.min, &min) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.max) && (mstring2ld(args.max, &max) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (NULL != args.min && NULL != args.max && max < min) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_MIN_MAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (skipStaleVersionWrite(ctx, key, ex_flags, version)) {
+        return REDISMODULE_OK;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        if (ex_flags & TAIR_STRING_SET_XX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+        tair_string_obj = createTairStringTypeObject();
+        value = 0;
+    } else {
+        if (ex_flags & TAIR_STRING_SET_NX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+        if (isLeasePlaceholder(tair_string_obj)) {
+            value = 0;
+        } else if (mstring2ld(tair_string_obj->value, &value) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_FLOAT);
+            return REDISMODULE_ERR;
+        }
+        if (decayActive(tair_string_obj)) {
+            value = decayValue(tair_string_obj, value, now);
+        }
+
+        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    oldvalue = value;
+
+    if (isnan(oldvalue + incr) || isinf(oldvalue + incr) || (args.max != NULL && oldvalue + incr > max)
+        || (args.min != NULL && oldvalue + incr < min)) {
+        if (type == REDISMODULE_KEYTYPE_EMPTY && tair_string_obj) TairStringTypeReleaseObject(tair_string_obj);
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+        return REDISMODULE_ERR;
+    }
+
+    historyRecord(tair_string_obj);
+    dropValueState(tair_string_obj);
+    if (ex_flags & (TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
+        tair_string_obj->version = version;
+    } else {
+        tair_string_obj->version++;
+    }
+
+    value += incr;
+
+    char dbuf[MAX_LONG_DOUBLE_CHARS];
+    int dlen = m_ld2string(dbuf, sizeof(dbuf), value, 1);
+
+    if (type != REDISMODULE_KEYTYPE_EMPTY) {
+        if (tair_string_obj->value) {
+            RedisModule_FreeString(ctx, tair_string_obj->value);
+            tair_string_obj->value = NULL;
+        }
+    } else {
+        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
+    }
+    tair_string_obj->value = RedisModule_CreateString(NULL, dbuf, dlen);
+
+    if (args.expire) {
+        if (ex_flags & TAIR_STRING_SET_EX) {
+            expire *= 1000;
+        }
+        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
+            milliseconds = expire - RedisModule_Milliseconds();
+            if (milliseconds < 0) {
+                milliseconds = 0;
+            }
+        } else {
+            milliseconds = expire;
+        }
+        milliseconds = jitterExpire(milliseconds, jitter);
+
+        RedisModule_SetExpire(key, milliseconds);
+    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
+        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    }
+
+    if (args.expire) {
+        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version,
+                              "PXAT", (milliseconds + RedisModule_Milliseconds()));
+    } else {
+        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version);
+    }
+    replicateTags(ctx, argv[1], tair_string_obj);
+
+    if (args.halflife) {
+        setDecay(tair_string_obj, halflife, now);
+        RedisModule_Replicate(ctx, "EXDECAYSET", "sll", argv[1], halflife, now);
+    }
+
+    notifyKeyModified(ctx, argv[1], "exincrbyfloat", tair_string_obj->version, tair_string_obj);
+
+    RedisModule_ReplyWithString(ctx, tair_string_obj->value);
+    return REDISMODULE_OK;
+}
+
+/* EXREQIDSET <key> <reqid> <value> <version> <expire_at> <size> <segments>
+ *
+ * Record an already applied request in the dedup ring of key. This is what
+ * EXINCRBY ... REQID replicates and what the AOF rewrite emits, it is not
+ * meant to be called by clients. */
+int TairStringTypeExReqIdSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 8) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long value, version, expire_at, size, segments;
+    if (RedisModule_StringToLongLong(argv[3], &value) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[4], &version) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[5], &expire_at) != REDISMODULE_OK || version < 0
+        || RedisModule_StringToLongLong(argv[6], &size) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[7], &segments) != REDISMODULE_OK || segments < 0
+        || segments > TAIRSTRING_RESERVE_MAX_SEGMENTS) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    addReqId(RedisModule_ModuleTypeGetValue(key), argv[2], value, (uint64_t)version, expire_at, size,
+             (uint32_t)segments);
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* EXDECAYSET <key> <halflife> <timestamp>
+ *
+ * Make the current value of key decay from timestamp on. This is what
+ * EXINCRBYFLOAT ... HALFLIFE replicates and what the AOF rewrite emits, it is
+ * not meant to be called by clients. */
+int TairStringTypeExDecaySet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long halflife, ts;
+    if (RedisModule_StringToLongLong(argv[2], &halflife) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[3], &ts) != REDISMODULE_OK || halflife <= 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    setDecay(RedisModule_ModuleTypeGetValue(key), halflife, ts);
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* EXSOFTSET <key> <soft_expire_at>
+ *
+ * Set the soft expire of the current value of key. This is what EXSET ...
+ * SOFTTTL replicates and what the AOF rewrite emits, it is not meant to be
+ * called by clients. */
+int TairStringTypeExSoftSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long soft_expire_at;
+    if (RedisModule_StringToLongLong(argv[2], &soft_expire_at) != REDISMODULE_OK || soft_expire_at <= 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    setSoftTTL(RedisModule_ModuleTypeGetValue(key), soft_expire_at);
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* EXRECOMPUTESET <key> <recompute_ms>
+ *
+ * Set the recompute time hint of the current value of key, this is what
+ * EXSET ... RECOMPUTE replicates and what the AOF rewrite emits, it is not
+ * meant to be called by clients. */
+int TairStringTypeExRecomputeSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long recompute;
+    if (RedisModule_StringToLongLong(argv[2], &recompute) != REDISMODULE_OK || recompute <= 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    setRecompute(RedisModule_ModuleTypeGetValue(key), recompute);
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* EXNSSET <key> <generation>
+ *
+ * Stamp the current value of key with a namespace generation, this is what
+ * EXSET ... NS replicates and what the AOF rewrite emits, it is not meant to
+ * be called by clients. */
+int TairStringTypeExNsSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long generation;
+    if (RedisModule_StringToLongLong(argv[2], &generation) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    setNamespace(RedisModule_ModuleTypeGetValue(key), generation);
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* EXSETVERGT <key> <value> <version> [<key> <value> <version> ...]
+ *
+ * Batch form of EXSET <key> <value> VERGT <version>. */
+int TairStringTypeExSetVerGt_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4 || (argc - 1) % 3 != 0) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    int j;
+    long long version;
+    for (j = 3; j < argc; j += 3) {
+        if (RedisModule_StringToLongLong(argv[j], &version) != REDISMODULE_OK || version < 0) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    RedisModule_ReplyWithArray(ctx, (argc - 1) / 3);
+    for (j = 1; j < argc; j += 3) {
+        RedisModule_StringToLongLong(argv[j + 2], &version);
+
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[j], REDISMODULE_READ | REDISMODULE_WRITE);
+        int type = RedisModule_KeyType(key);
+        if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            RedisModule_CloseKey(key);
+            continue;
+        }
+
+        if (isStaleVersion(key, version)) {
+            RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_SKIPPED);
+            RedisModule_CloseKey(key);
+            continue;
+        }
+
+        TairStringObj *o;
+        if (type == REDISMODULE_KEYTYPE_EMPTY) {
+            o = createTairStringTypeObject();
+            RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+        } else {
+            o = RedisModule_ModuleTypeGetValue(key);
+            historyRecord(o);
+            dropValueState(o);
+            RedisModule_FreeString(NULL, o->value);
+        }
+        o->value = argv[j + 1];
+        RedisModule_RetainString(NULL, argv[j + 1]);
+        o->version = (uint64_t)version;
+        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+
+        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[j], o->value, "ABS", o->version);
+        replicateTags(ctx, argv[j], o);
+        notifyKeyModified(ctx, argv[j], "exsetvergt", o->version, o);
+        RedisModule_ReplyWithLongLong(ctx, (long long)o->version);
+        RedisModule_CloseKey(key);
+    }
+
+    return REDISMODULE_OK;
+}
+
+/* EXSETVER <key> <version> */
+int TairStringTypeExSetVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version = 0;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    } else {
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (version <= 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModule_ReplicateVerbatim(ctx);
+    historyRecord(tair_string_obj);
+    tair_string_obj->version = version;
+    notifyKeyModified(ctx, argv[1], "exsetver", tair_string_obj->version, tair_string_obj);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* EXCAS <key> <new_value> <version> [EX/EXAT/PX/PXAT time] [KEEPTTL]
+ * EXCAS <key> <new_value> DIGEST <digest> [EX/EXAT/PX/PXAT time] [KEEPTTL] */
+int TairStringTypeExCas_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    /* A version is always an integer, so DIGEST can not be mistaken for one. */
+    int with_digest = argc >= 5 && !mstringcasecmp(argv[3], "digest");
+    long long version = 0;
+    uint64_t digest = 0;
+    long long milliseconds = 0, expire = 0;
+    long long jitter = 0;
+    TairStringExArgs args;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL |
+                      TAIR_STRING_SET_WITH_JITTER;
+    if (parseAndGetExFlags(argv, argc, with_digest ? 5 : 4, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (mstring2jitter(args.jitter, &jitter) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.expire) && (RedisModule_StringToLongLong(args.expire, &expire) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (with_digest) {
+        if (mstring2digest(argv[4], &digest) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_DIGEST);
+            return REDISMODULE_ERR;
+        }
+    } else if (RedisModule_StringToLongLong(argv[3], &version) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
+        return REDISMODULE_ERR;
+    }
+
+    if ((args.expire && expire <=0) || version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithLongLong(ctx, -1);
+        return REDISMODULE_OK;
+    } else {
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    if (with_digest ? tairStringObjDigest(tair_string_obj) != digest : tair_string_obj->version != version) {
+        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+        /* Here we can not use RedisModule_ReplyWithError directly, because this
+        will cause jedis throw an exception, and the client can not read the
+        later version and value. */
+        RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_VERSION);
+        RedisModule_ReplyWithString(ctx, tair_string_obj->value);
+        RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+        RedisModule_ReplySetArrayLength(ctx, 3);
+        return REDISMODULE_ERR;
+    }
+
+    historyRecord(tair_string_obj);
+    dropValueState(tair_string_obj);
+    if (tair_string_obj->value) {
+        RedisModule_FreeString(ctx, tair_string_obj->value);
+        tair_string_obj->value = NULL;
+    }
+    tair_string_obj->value = argv[2];
+    RedisModule_RetainString(NULL, argv[2]);
+    tair_string_obj->version++;
+
+    if (args.expire) {
+        if (ex_flags & TAIR_STRING_SET_EX) {
+            expire *= 1000;
+        }
+        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
+            milliseconds = expire - RedisModule_Milliseconds();
+            if (milliseconds < 0) {
+                milliseconds = 0;
+            }
+        } else {
+            milliseconds = expire;
+        }
+        milliseconds = jitterExpire(milliseconds, jitter);
+
+        RedisModule_SetExpire(key, milliseconds);
+    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
+        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    }
+
+    if (args.expire) {
+        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version,
+                              "PXAT", (milliseconds + RedisModule_Milliseconds()));
+    } else {
+        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version);
+    }
+    replicateTags(ctx, argv[1], tair_string_obj);
+
+    notifyKeyModified(ctx, argv[1], "excas", tair_string_obj->version, tair_string_obj);
+
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    RedisModule_ReplyWithSimpleString(ctx, "");
+    RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    RedisModule_ReplySetArrayLength(ctx, 3);
+    return REDISMODULE_OK;
+}
+
+/* EXCAD <key> <version> */
+int TairStringTypeExCad_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version = 0;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithLongLong(ctx, -1);
+        return REDISMODULE_OK;
+    } else {
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    if (tair_string_obj->version != version) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_Replicate(ctx, "DEL", "s", argv[1]);
+    RedisModule_DeleteKey(key);
+    notifyKeyModified(ctx, argv[1], "excad", version, NULL);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* The value of the native string key opened as key. StringDMA unshares
+ * encoded values into raw strings even for reading, which would e.g. turn a
+ * shared integer into an object of its own. Only values short enough to be
+ * int encoded are read with a nested GET, a copy of 20 bytes at most, the
+ * others in place. *reply is set to the reply to free, if any. */
+static const char *stringKeyValue(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname,
+                                  RedisModuleCallReply **reply, size_t *len) {
+    *reply = NULL;
+    if (RedisModule_ValueLength(key) > TAIRSTRING_INT_STR_SIZE_LIMIT) {
+        return RedisModule_StringDMA(key, len, REDISMODULE_READ);
+    }
+    *reply = RedisModule_Call(ctx, "GET", "s", keyname);
+    if (*reply == NULL || RedisModule_CallReplyType(*reply) != REDISMODULE_REPLY_STRING) {
+        return NULL;
+    }
+    return RedisModule_CallReplyStringPtr(*reply, len);
+}
+
+/* Compare the value of the native string key with expect. The length is
+ * known without reading the value, which most mismatches are told by. */
+static int stringKeyValueEquals(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname,
+                                RedisModuleString *expect) {
+    size_t cur_len, expect_len;
+    const char *expect_ptr = RedisModule_StringPtrLen(expect, &expect_len);
+    if (RedisModule_ValueLength(key) != expect_len) return 0;
+
+    RedisModuleCallReply *reply;
+    const char *cur_ptr = stringKeyValue(ctx, key, keyname, &reply, &cur_len);
+    int equals = cur_ptr != NULL && cur_len == expect_len && memcmp(cur_ptr, expect_ptr, cur_len) == 0;
+    if (reply) RedisModule_FreeCallReply(reply);
+    return equals;
+}
+
+/* Same as stringKeyValueEquals() but against the digest of the value. Native
+ * strings have nowhere to cache it, so it is computed on every call, which
+ * still saves shipping the old value over the network. */
+static int stringKeyDigestEquals(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname,
+                                 uint64_t digest) {
+    size_t cur_len;
+    RedisModuleCallReply *reply;
+    const char *cur_ptr = stringKeyValue(ctx, key, keyname, &reply, &cur_len);
+    int equals = cur_ptr != NULL && stringDigest(cur_ptr, cur_len) == digest;
+    if (reply) RedisModule_FreeCallReply(reply);
+    return equals;
+}
+
+/* Shared by CAD and CADDIGEST, argv[2] is either the expected value or its
+ * digest. */
+static int stringTypeCadGeneric(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int with_digest) {
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    uint64_t digest = 0;
+    if (with_digest && mstring2digest(argv[2], &digest) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_DIGEST);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && type != REDISMODULE_KEYTYPE_STRING) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithLongLong(ctx, -1);
+        return REDISMODULE_OK;
+    }
+
+    if (with_digest ? !stringKeyDigestEquals(ctx, key, argv[1], digest)
+                    : !stringKeyValueEquals(ctx, key, argv[1], argv[2])) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_DeleteKey(key);
+    RedisModule_Replicate(ctx, "DEL", "s", argv[1]);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* CAD <key> <value> */
+int StringTypeCad_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    return stringTypeCadGeneric(ctx, argv, argc, 0);
+}
+
+/* CADDIGEST <key> <digest> */
+int StringTypeCadDigest_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    return stringTypeCadGeneric(ctx, argv, argc, 1);
+}
+
+/* Shared by CAS and CASDIGEST, argv[2] is either the expected value or its
+ * digest. */
+static int stringTypeCasGeneric(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int with_digest) {
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long milliseconds = 0, expire = 0;
+    long long jitter = 0;
+    TairStringExArgs args;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL |
+                      TAIR_STRING_SET_WITH_JITTER;
+    if (parseAndGetExFlags(argv, argc, 4, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (mstring2jitter(args.jitter, &jitter) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.expire) && (RedisModule_StringToLongLong(args.expire, &expire) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((args.expire && expire <=0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    uint64_t digest = 0;
+    if (with_digest && mstring2digest(argv[2], &digest) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_DIGEST);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && type != REDISMODULE_KEYTYPE_STRING) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithLongLong(ctx, -1);
+        return REDISMODULE_OK;
+    }
+
+    if (with_digest ? !stringKeyDigestEquals(ctx, key, argv[1], digest)
+                    : !stringKeyValueEquals(ctx, key, argv[1], argv[2])) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    if (RedisModule_StringSet(key, argv[3]) != REDISMODULE_OK) {
+        return REDISMODULE_ERR;
+    }
+
+    if (args.expire) {
+        if (ex_flags & TAIR_STRING_SET_EX) {
+            expire *= 1000;
+        }
+        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
+            milliseconds = expire - RedisModule_Milliseconds();
+            if (milliseconds < 0) {
+                milliseconds = 0;
+            }
+        } else {
+            milliseconds = expire;
+        }
+        milliseconds = jitterExpire(milliseconds, jitter);
+
+        RedisModule_SetExpire(key, milliseconds);
+    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
+        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    }
+
+    /* A single CAS is replicated, with the relative expire rewritten to an
+     * absolute one. It also keeps KEEPTTL working on replicas. */
+    if (args.expire) {
+        RedisModule_Replicate(ctx, with_digest ? "CASDIGEST" : "CAS", "ssscl", argv[1], argv[2], argv[3], "PXAT",
+                              (milliseconds + RedisModule_Milliseconds()));
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* CAS <Key> <oldvalue> <newvalue> [EX/EXAT/PX/PXAT time] [KEEPTTL] */
+int StringTypeCas_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    return stringTypeCasGeneric(ctx, argv, argc, 0);
+}
+
+/* CASDIGEST <Key> <digest> <newvalue> [EX/EXAT/PX/PXAT time] [KEEPTTL] */
+int StringTypeCasDigest_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    return stringTypeCasGeneric(ctx, argv, argc, 1);
+}
+
+/* EXPREPEND <key> <value> [NX|XX] [VER/ABS version] */
+int TairStringTypeExPrepend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version = 0;
+    TairStringExArgs args;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER |
+                               TAIR_STRING_SET_WITH_GT_VER;
+    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.version) && (RedisModule_StringToLongLong(args.version, &version) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    size_t originalLength;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    RedisModuleString *newvalue;
+    int type = RedisModule_KeyType(key);
+
+    if (skipStaleVersionWrite(ctx, key, ex_flags, version)) {
+        return REDISMODULE_OK;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        /* not exist: result = argv[2] */
+        if (ex_flags & TAIR_STRING_SET_XX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+        tair_string_obj = createTairStringTypeObject();
+        tair_string_obj->value = argv[2];
+        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
+        RedisModule_RetainString(ctx, argv[2]);
+    } else {
+        /* exist: result = argv[2] + original */
+        /* Statements like "tair_string_obj->value = argv[2];
+        Append(tair_string_obj->value, original);" would lead to a mistake when
+        replicating the command from master to slave, so it's necessary to
+        create a copy of argv[2] and use the copy to get the command executed.
+      */
+
+        if (ex_flags & TAIR_STRING_SET_NX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            return REDISMODULE_ERR;
+        }
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+
+        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
+            return REDISMODULE_ERR;
+        }
+
+        /* Convert RedisModuleString to cstring to use StringAppendBuffer() */
+        const char *c_string_original = RedisModule_StringPtrLen(tair_string_obj->value, &originalLength);
+        newvalue = RedisModule_CreateStringFromString(ctx, argv[2]);
+
+        if (RedisModule_StringAppendBuffer(ctx, newvalue, c_string_original, originalLength) == REDISMODULE_ERR) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_APPENDBUFFER);
+            return REDISMODULE_ERR;
+        }
+
+        historyRecord(tair_string_obj);
+        dropValueState(tair_string_obj);
+        if (tair_string_obj->value) {
+            RedisModule_FreeString(ctx, tair_string_obj->value);
+        }
+
+        tair_string_obj->value = newvalue;
+        RedisModule_RetainString(NULL, newvalue);
+    }
+
+    if (ex_flags & (TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
+        tair_string_obj->version = version;
+    } else {
+        tair_string_obj->version++;
+    }
+
+    RedisModule_ReplicateVerbatim(ctx);
+    notifyKeyModified(ctx, argv[1], "exprepend", tair_string_obj->version, tair_string_obj);
+    RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    return REDISMODULE_OK;
+}
+
+/* EXAPPEND <key> <value> [NX|XX] [VER/ABS version] */
+int TairStringTypeExAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version = 0;
+    TairStringExArgs args;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER |
+                               TAIR_STRING_SET_WITH_GT_VER;
+    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((NULL != args.version) && (RedisModule_StringToLongLong(args.version, &version) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    size_t appendLength;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+
+    if (skipStaleVersionWrite(ctx, key, ex_flags, version)) {
+        return REDISMODULE_OK;
+    }
+
+    TairStringObj *tair_string_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        /* not exist: result = argv[2] */
+        if (ex_flags & TAIR_STRING_SET_XX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+
+        tair_string_obj = createTairStringTypeObject();
+        tair_string_obj->value = argv[2];
+        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
+        RedisModule_RetainString(NULL, argv[2]);
+
+    } else {
+        /* exist: result = original + argv[2] */
+        if (ex_flags & TAIR_STRING_SET_NX) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_ERR;
+        }
+        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            return REDISMODULE_ERR;
+        }
+        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+
+        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
+            return REDISMODULE_ERR;
+        }
+
+        /* The value is appended to in place, keep a copy first. */
+        historyRecord(tair_string_obj);
+        dropValueState(tair_string_obj);
+        /* Convert RedisModuleString to cstring to use StringAppendBuffer() */
+        const char *c_string_argv = RedisModule_StringPtrLen(argv[2], &appendLength);
+
+        if (RedisModule_StringAppendBuffer(ctx, tair_string_obj->value, c_string_argv, appendLength)
+            == REDISMODULE_ERR) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_APPENDBUFFER);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    if (ex_flags & (TAIR_STRING_SET_WITH_ABS_VER | TAIR_STRING_SET_WITH_GT_VER)) {
+        tair_string_obj->version = version;
+    } else {
+        tair_string_obj->version++;
+    }
+
+    RedisModule_ReplicateVerbatim(ctx);
+    notifyKeyModified(ctx, argv[1], "exappend", tair_string_obj->version, tair_string_obj);
+    RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    return REDISMODULE_OK;
+}
+
+/* EXGAE <key> <EX time | EXAT time | PX time | PXAT time> */
+int TairStringTypeExGAE_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+ 
+    long long expire = 0, milliseconds = 0;
+    TairStringExArgs args;
+    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
+    unsigned int allow_flags = TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | TAIR_STRING_SET_ABS_EXPIRE;
+    if (parseAndGetExFlags(argv, argc, 2, &ex_flags, &args, allow_flags) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_StringToLongLong(args.expire, &expire) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if ((args.expire && expire <=0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+
+    if (args.expire) {
+        if (ex_flags & TAIR_STRING_SET_EX) {
+            expire *= 1000;
+        }
+        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
+            milliseconds = expire - RedisModule_Milliseconds();
+            if (milliseconds < 0) {
+                milliseconds = 0;
+            }
+        } else {
+            milliseconds = expire;
+        }
+
+        RedisModule_SetExpire(key, milliseconds);
+    }
+
+    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+
+    RedisModule_ReplicateVerbatim(ctx);
+    notifyKeyModified(ctx, argv[1], "exgae", o->version, o);
+
+    RedisModule_ReplyWithArray(ctx, 3);
+    RedisModule_ReplyWithString(ctx, o->value);
+    RedisModule_ReplyWithLongLong(ctx, o->version);
+    RedisModule_ReplyWithLongLong(ctx, (long long)o->flags);
+    return REDISMODULE_OK;
+}
+
+/* ================================= EXAPPLY =================================*/
+
+/* EXAPPLY runs a small stack program against the value and version of a key,
+ * so that a read-modify-write needs neither an EXGET/EXCAS retry loop nor Lua.
+ *
+ * A program is a list of space separated tokens. Integers and $n (the n-th
+ * argument after the program) are pushed on the stack, any other token is an
+ * op. There are no jumps, so a program never runs more steps than it has
+ * tokens, and since every op has a fixed stack effect a program is fully
+ * checked before the key is touched. The top of the stack at the end is the
+ * new value. */
+#define TAIRSTRING_APPLY_MAX_OPS 128
+#define TAIRSTRING_APPLY_MAX_STACK 32
+#define TAIRSTRING_APPLY_MAX_LEN (512LL * 1024 * 1024)
+
+#define TAIRSTRING_APPLY_OK 0
+#define TAIRSTRING_APPLY_ABORTED 1
+#define TAIRSTRING_APPLY_ERR 2
+
+typedef enum {
+    APPLY_OP_PUSH_INT,
+    APPLY_OP_PUSH_ARG,
+    APPLY_OP_VAL,
+    APPLY_OP_VER,
+    APPLY_OP_DUP,
+    APPLY_OP_SWAP,
+    APPLY_OP_POP,
+    APPLY_OP_ADD,
+    APPLY_OP_SUB,
+    APPLY_OP_MUL,
+    APPLY_OP_DIV,
+    APPLY_OP_MOD,
+    APPLY_OP_MIN,
+    APPLY_OP_MAX,
+    APPLY_OP_EQ,
+    APPLY_OP_NE,
+    APPLY_OP_LT,
+    APPLY_OP_LE,
+    APPLY_OP_GT,
+    APPLY_OP_GE,
+    APPLY_OP_NOT,
+    APPLY_OP_SEQ,
+    APPLY_OP_LEN,
+    APPLY_OP_CAT,
+    APPLY_OP_SUBSTR,
+    APPLY_OP_SETRANGE,
+    APPLY_OP_ABORTIF,
+} TairStringApplyOpCode;
+
+static const struct {
+    const char *name;
+    TairStringApplyOpCode code;
+    int pop, push;
+} TairStringApplyOps[] = {
+    {"val", APPLY_OP_VAL, 0, 1},
+    {"ver", APPLY_OP_VER, 0, 1},
+    {"dup", APPLY_OP_DUP, 1, 2},
+    {"swap", APPLY_OP_SWAP, 2, 2},
+    {"pop", APPLY_OP_POP, 1, 0},
+    {"add", APPLY_OP_ADD, 2, 1},
+    {"sub", APPLY_OP_SUB, 2, 1},
+    {"mul", APPLY_OP_MUL, 2, 1},
+    {"div", APPLY_OP_DIV, 2, 1},
+    {"mod", APPLY_OP_MOD, 2, 1},
+    {"min", APPLY_OP_MIN, 2, 1},
+    {"max", APPLY_OP_MAX, 2, 1},
+    {"eq", APPLY_OP_EQ, 2, 1},
+    {"ne", APPLY_OP_NE, 2, 1},
+    {"lt", APPLY_OP_LT, 2, 1},
+    {"le", APPLY_OP_LE, 2, 1},
+    {"gt", APPLY_OP_GT, 2, 1},
+    {"ge", APPLY_OP_GE, 2, 1},
+    {"not", APPLY_OP_NOT, 1, 1},
+    {"seq", APPLY_OP_SEQ, 2, 1},
+    {"len", APPLY_OP_LEN, 1, 1},
+    {"cat", APPLY_OP_CAT, 2, 1},
+    {"substr", APPLY_OP_SUBSTR, 3, 1},
+    {"setrange", APPLY_OP_SETRANGE, 3, 1},
+    {"abortif", APPLY_OP_ABORTIF, 1, 0},
+    {NULL, 0, 0, 0},
+};
+
+typedef struct TairStringApplyInstr {
+    TairStringApplyOpCode code;
+    long long operand;
+} TairStringApplyInstr;
+
+/* Translate program into code, checking every op and argument reference and
+ * that the stack never underflows or grows past TAIRSTRING_APPLY_MAX_STACK. */
+static int applyCompile(RedisModuleString *program, int nargs, TairStringApplyInstr *code, int *ncode) {
+    size_t len;
+    const char *p = RedisModule_StringPtrLen(program, &len), *end = p + len;
+    int n = 0, depth = 0;
+
+    while (1) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) break;
+        const char *tok = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        size_t toklen = p - tok;
+
+        if (n == TAIRSTRING_APPLY_MAX_OPS) return REDISMODULE_ERR;
+        TairStringApplyInstr *instr = &code[n++];
+        int pop = 0, push = 1;
+        if (m_string2ll(tok, toklen, &instr->operand)) {
+            instr->code = APPLY_OP_PUSH_INT;
+        } else if (tok[0] == '$') {
+            if (!m_string2ll(tok + 1, toklen - 1, &instr->operand) || instr->operand < 1 || instr->operand > nargs) {
+                return REDISMODULE_ERR;
+            }
+            instr->code = APPLY_OP_PUSH_ARG;
+        } else {
+            int j;
+            for (j = 0; TairStringApplyOps[j].name; j++) {
+                if (strlen(TairStringApplyOps[j].name) == toklen && !strncasecmp(TairStringApplyOps[j].name, tok, toklen)) {
+                    break;
+                }
+            }
+            if (TairStringApplyOps[j].name == NULL) return REDISMODULE_ERR;
+            instr->code = TairStringApplyOps[j].code;
+            pop = TairStringApplyOps[j].pop;
+            push = TairStringApplyOps[j].push;
+        }
+
+        if (depth < pop) return REDISMODULE_ERR;
+        depth += push - pop;
+        if (depth > TAIRSTRING_APPLY_MAX_STACK) return REDISMODULE_ERR;
+    }
+
+    /* The program must leave the new value on the stack. */
+    if (depth < 1) return REDISMODULE_ERR;
+    *ncode = n;
+    return REDISMODULE_OK;
+}
+
+/* Integer arithmetic of EXAPPLY, returns the error to reply with, or NULL. */
+static const char *applyArith(TairStringApplyOpCode op, long long a, long long b, long long *r) {
+    switch (op) {
+    case APPLY_OP_ADD:
+        if ((b > 0 && a > LLONG_MAX - b) || (b < 0 && a < LLONG_MIN - b)) return TAIRSTRING_ERRORMSG_OVERFLOW;
+        *r = a + b;
+        break;
+    case APPLY_OP_SUB:
+        if ((b < 0 && a > LLONG_MAX + b) || (b > 0 && a < LLONG_MIN + b)) return TAIRSTRING_ERRORMSG_OVERFLOW;
+        *r = a - b;
+        break;
+    case APPLY_OP_MUL:
+        if ((a > 0 && b > 0 && a > LLONG_MAX / b) || (a > 0 && b < 0 && b < LLONG_MIN / a)
+            || (a < 0 && b > 0 && a < LLONG_MIN / b) || (a < 0 && b < 0 && a < LLONG_MAX / b)) {
+            return TAIRSTRING_ERRORMSG_OVERFLOW;
+        }
+        *r = a * b;
+        break;
+    case APPLY_OP_DIV:
+    case APPLY_OP_MOD:
+        if (b == 0) return TAIRSTRING_ERRORMSG_DIV_ZERO;
+        if (a == LLONG_MIN && b == -1) return TAIRSTRING_ERRORMSG_OVERFLOW;
+        *r = op == APPLY_OP_DIV ? a / b : a % b;
+        break;
+    case APPLY_OP_MIN: *r = a < b ? a : b; break;
+    case APPLY_OP_MAX: *r = a > b ? a : b; break;
+    case APPLY_OP_EQ: *r = a == b; break;
+    case APPLY_OP_NE: *r = a != b; break;
+    case APPLY_OP_LT: *r = a < b; break;
+    case APPLY_OP_LE: *r = a <= b; break;
+    case APPLY_OP_GT: *r = a > b; break;
+    case APPLY_OP_GE: *r = a >= b; break;
+    default: return TAIRSTRING_ERRORMSG_PROGRAM;
+    }
+    return NULL;
+}
+
+/* Run a compiled program against value and version. Every stack slot holds a
+ * reference of its own, so that replaced strings are freed right away, and
+ * the strings built by the program may not add up to more than
+ * TAIRSTRING_APPLY_MAX_LEN bytes, since they are allocated before deny-oom
+ * could step in. On TAIRSTRING_APPLY_OK *result is the new value, owned by
+ * the caller, and on TAIRSTRING_APPLY_ERR *err the error to reply with. */
+static int applyRun(TairStringApplyInstr *code, int ncode, RedisModuleString **args, RedisModuleString *value,
+                    uint64_t version, RedisModuleString **result, const char **err) {
+    static const char zeros[4096] = {0};
+    RedisModuleString *stack[TAIRSTRING_APPLY_MAX_STACK], *tmp;
+    long long a, b, c, allocated = 0;
+    size_t alen, blen;
+    const char *aptr, *bptr;
+    int sp = 0, pc, ret = TAIRSTRING_APPLY_OK;
+
+#define APPLY_PUSH(s) (stack[sp++] = (s))
+#define APPLY_DROP() RedisModule_FreeString(NULL, stack[--sp])
+#define APPLY_POP_INT(v)                                                                                            \
+    do {                                                                                                            \
+        if (RedisModule_StringToLongLong(stack[sp - 1], &(v)) != REDISMODULE_OK) {                                  \
+            *err = TAIRSTRING_ERRORMSG_NO_INT;                                                                      \
+            goto fail;                                                                                              \
+        }                                                                                                           \
+        APPLY_DROP();                                                                                               \
+    } while (0)
+#define APPLY_ALLOC(n)                                                                                              \
+    do {                                                                                                            \
+        if ((long long)(n) > TAIRSTRING_APPLY_MAX_LEN - allocated) {                                                \
+            *err = TAIRSTRING_ERRORMSG_TOO_LARGE;                                                                   \
+            goto fail;                                                                                              \
+        }                                                                                                           \
+        allocated += (long long)(n);                                                                                \
+    } while (0)
+
+    for (pc = 0; pc < ncode; pc++) {
+        TairStringApplyOpCode op = code[pc].code;
+        switch (op) {
+        case APPLY_OP_PUSH_INT:
+            APPLY_PUSH(RedisModule_CreateStringFromLongLong(NULL, code[pc].operand));
+            break;
+        case APPLY_OP_PUSH_ARG:
+            RedisModule_RetainString(NULL, args[code[pc].operand - 1]);
+            APPLY_PUSH(args[code[pc].operand - 1]);
+            break;
+        case APPLY_OP_VAL:
+            RedisModule_RetainString(NULL, value);
+            APPLY_PUSH(value);
+            break;
+        case APPLY_OP_VER:
+            APPLY_PUSH(RedisModule_CreateStringFromLongLong(NULL, (long long)version));
+            break;
+        case APPLY_OP_DUP:
+            tmp = stack[sp - 1];
+            RedisModule_RetainString(NULL, tmp);
+            APPLY_PUSH(tmp);
+            break;
+        case APPLY_OP_SWAP:
+            tmp = stack[sp - 1];
+            stack[sp - 1] = stack[sp - 2];
+            stack[sp - 2] = tmp;
+            break;
+        case APPLY_OP_POP:
+            APPLY_DROP();
+            break;
+        case APPLY_OP_NOT:
+            APPLY_POP_INT(a);
+            APPLY_PUSH(RedisModule_CreateStringFromLongLong(NULL, !a));
+            break;
+        case APPLY_OP_ABORTIF:
+            APPLY_POP_INT(a);
+            if (a) {
+                ret = TAIRSTRING_APPLY_ABORTED;
+                goto cleanup;
+            }
+            break;
+        case APPLY_OP_SEQ:
+            bptr = RedisModule_StringPtrLen(stack[sp - 1], &blen);
+            aptr = RedisModule_StringPtrLen(stack[sp - 2], &alen);
+            c = alen == blen && memcmp(aptr, bptr, alen) == 0;
+            APPLY_DROP();
+            APPLY_DROP();
+            APPLY_PUSH(RedisModule_CreateStringFromLongLong(NULL, c));
+            break;
+        case APPLY_OP_LEN:
+            RedisModule_StringPtrLen(stack[sp - 1], &alen);
+            APPLY_DROP();
+            APPLY_PUSH(RedisModule_CreateStringFromLongLong(NULL, (long long)alen));
+            break;
+        case APPLY_OP_CAT:
+            bptr = RedisModule_StringPtrLen(stack[sp - 1], &blen);
+            RedisModule_StringPtrLen(stack[sp - 2], &alen);
+            APPLY_ALLOC(alen + blen);
+            tmp = RedisModule_CreateStringFromString(NULL, stack[sp - 2]);
+            RedisModule_StringAppendBuffer(NULL, tmp, bptr, blen);
+            APPLY_DROP();
+            APPLY_DROP();
+            APPLY_PUSH(tmp);
+            break;
+        case APPLY_OP_SUBSTR:
+            /* <string> <start> <end>, inclusive and negative offsets count
+             * from the end, like GETRANGE. */
+            APPLY_POP_INT(c);
+            APPLY_POP_INT(b);
+            aptr = RedisModule_StringPtrLen(stack[sp - 1], &alen);
+            if (b < 0) b += (long long)alen;
+            if (c < 0) c += (long long)alen;
+            if (b < 0) b = 0;
+            if (c < 0) c = 0;
+            if (c >= (long long)alen) c = (long long)alen - 1;
+            if (alen == 0 || b > c) {
+                tmp = RedisModule_CreateString(NULL, "", 0);
+            } else {
+                APPLY_ALLOC(c - b + 1);
+                tmp = RedisModule_CreateString(NULL, aptr + b, c - b + 1);
+            }
+            APPLY_DROP();
+            APPLY_PUSH(tmp);
+            break;
+        case APPLY_OP_SETRANGE: {
+            /* <string> <offset> <bytes>, zero padded like SETRANGE. */
+            bptr = RedisModule_StringPtrLen(stack[sp - 1], &blen);
+            if (RedisModule_StringToLongLong(stack[sp - 2], &b) != REDISMODULE_OK) {
+                *err = TAIRSTRING_ERRORMSG_NO_INT;
+                goto fail;
+            }
+            aptr = RedisModule_StringPtrLen(stack[sp - 3], &alen);
+            if (b < 0) {
+                *err = TAIRSTRING_ERRORMSG_OFFSET;
+                goto fail;
+            }
+            if (b > TAIRSTRING_APPLY_MAX_LEN - (long long)blen) {
+                *err = TAIRSTRING_ERRORMSG_TOO_LARGE;
+                goto fail;
+            }
+            size_t newlen = (size_t)b + blen > alen ? (size_t)b + blen : alen;
+            if (blen == 0) {
+                /* Nothing to write, not even padding. */
+                RedisModule_RetainString(NULL, stack[sp - 3]);
+                tmp = stack[sp - 3];
+            } else {
+                /* Built piece by piece: head, padding, bytes and tail. */
+                APPLY_ALLOC(newlen);
+                size_t head = alen < (size_t)b ? alen : (size_t)b, pad = (size_t)b - head;
+                tmp = RedisModule_CreateString(NULL, aptr, head);
+                while (pad) {
+                    size_t n = pad < sizeof(zeros) ? pad : sizeof(zeros);
+                    RedisModule_StringAppendBuffer(NULL, tmp, zeros, n);
+                    pad -= n;
+                }
+                RedisModule_StringAppendBuffer(NULL, tmp, bptr, blen);
+                if (alen > (size_t)b + blen) {
+                    RedisModule_StringAppendBuffer(NULL, tmp, aptr + b + blen, alen - (size_t)b - blen);
+                }
+            }
+            APPLY_DROP();
+            APPLY_DROP();
+            APPLY_DROP();
+            APPLY_PUSH(tmp);
+            break;
+        }
+        default:
+            APPLY_POP_INT(b);
+            APPLY_POP_INT(a);
+            if ((*err = applyArith(op, a, b, &c)) != NULL) goto fail;
+            APPLY_PUSH(RedisModule_CreateStringFromLongLong(NULL, c));
+            break;
+        }
+    }
+
+    *result = stack[--sp];
+    goto cleanup;
+
+fail:
+    ret = TAIRSTRING_APPLY_ERR;
+cleanup:
+    while (sp) APPLY_DROP();
+    return ret;
+
+#undef APPLY_ALLOC
+#undef APPLY_POP_INT
+#undef APPLY_DROP
+#undef APPLY_PUSH
+}
+
+/* EXAPPLY <key> <program> [arg ...] */
+int TairStringTypeExApply_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    TairStringApplyInstr code[TAIRSTRING_APPLY_MAX_OPS];
+    int ncode;
+    if (applyCompile(argv[2], argc - 3, code, &ncode) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_PROGRAM);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    /* A missing key is seen as an empty value at version 0. */
+    TairStringObj *o = type == REDISMODULE_KEYTYPE_EMPTY ? NULL : RedisModule_ModuleTypeGetValue(key);
+    RedisModuleString *result = NULL;
+    const char *err = NULL;
+    int ret = applyRun(code, ncode, argv + 3, o ? o->value : RedisModule_CreateString(ctx, "", 0),
+                       o ? o->version : 0, &result, &err);
+    if (ret == TAIRSTRING_APPLY_ERR) {
+        RedisModule_ReplyWithError(ctx, err);
+        return REDISMODULE_ERR;
+    } else if (ret == TAIRSTRING_APPLY_ABORTED) {
+        RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_ABORTED);
+        return REDISMODULE_OK;
+    }
+
+    if (o == NULL) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    }
+
+    historyRecord(o);
+    dropValueState(o);
+    /* The result holds a reference of its own even if it is the current
+     * value itself. */
+    if (o->value) {
+        RedisModule_FreeString(NULL, o->value);
+    }
+    o->value = result;
+    o->version++;
+
+    /* The TTL is left alone, KEEPTTL makes the replica do the same. */
+    RedisModule_Replicate(ctx, "EXSET", "ssclc", argv[1], o->value, "ABS", o->version, "KEEPTTL");
+    replicateTags(ctx, argv[1], o);
+    notifyKeyModified(ctx, argv[1], "exapply", o->version, o);
+
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithString(ctx, o->value);
+    RedisModule_ReplyWithLongLong(ctx, o->version);
+    return REDISMODULE_OK;
+}
+
+/* ================================== locks ==================================*/
+
+/* A lock is an exstrtype key whose value is the owner and whose ext holds the
+ * deadline, 0 meaning unlocked. The key is kept once the lock is released or
+ * expired, so that the version, returned as the fencing token, never goes
+ * back: every acquisition increases it. */
+static int isLock(TairStringObj *o) {
+    return o->ext && o->ext->lock_deadline;
+}
+
+static int lockIsHeld(TairStringObj *o, long long now) {
+    return o->ext && o->ext->lock_deadline > now;
+}
+
+/* Set the whole lock state and replicate it as EXLOCKSET, the deadline being
+ * absolute. */
+static void setLockState(RedisModuleCtx *ctx, RedisModuleString *keyname, TairStringObj *o, RedisModuleString *owner,
+                         long long deadline) {
+    if (o->value != owner) {
+        RedisModule_RetainString(NULL, owner);
+        if (o->value) {
+            RedisModule_FreeString(NULL, o->value);
+        }
+        o->value = owner;
+    }
+    tairStringObjExt(o)->lock_deadline = deadline;
+    RedisModule_Replicate(ctx, "EXLOCKSET", "ssll", keyname, o->value, (long long)o->version, deadline);
+}
+
+/* Open the key of a lock or semaphore for writing and parse the ttl if any,
+ * replying with an error and returning NULL on failure. */
+static RedisModuleKey *openWritableKey(RedisModuleCtx *ctx, RedisModuleString *keyname, RedisModuleString *ttl_p,
+                                       long long *ttl) {
+    if (ttl_p && (RedisModule_StringToLongLong(ttl_p, ttl) != REDISMODULE_OK || *ttl <= 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return NULL;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return NULL;
+    }
+    return key;
+}
+
+/* EXLOCK <key> <owner> <ttl_ms> */
+int TairStringTypeExLock_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long ttl;
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], argv[3], &ttl);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    long long now = RedisModule_Milliseconds();
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    } else {
+        o = RedisModule_ModuleTypeGetValue(key);
+        /* Never take over ordinary data. */
+        if (!isLock(o)) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NOT_LOCK);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    if (lockIsHeld(o, now)) {
+        /* Acquiring again as the current owner (e.g. a retry after a
+         * timeout) extends the lock and returns the same token. */
+        if (RedisModule_StringCompare(o->value, argv[2]) != 0) {
+            RedisModule_ReplyWithNull(ctx);
+            return REDISMODULE_OK;
+        }
+    } else {
+        o->version++;
+    }
+
+    setLockState(ctx, argv[1], o, argv[2], now + ttl);
+    notifyKeyModified(ctx, argv[1], "exlock", o->version, o);
+    RedisModule_ReplyWithLongLong(ctx, (long long)o->version);
+    return REDISMODULE_OK;
+}
+
+/* EXRENEW <key> <owner> <ttl_ms> */
+int TairStringTypeExRenew_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long ttl;
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], argv[3], &ttl);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    long long now = RedisModule_Milliseconds();
+    TairStringObj *o = RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY ? NULL : RedisModule_ModuleTypeGetValue(key);
+    if (o == NULL || !lockIsHeld(o, now) || RedisModule_StringCompare(o->value, argv[2]) != 0) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    setLockState(ctx, argv[1], o, o->value, now + ttl);
+    notifyKeyModified(ctx, argv[1], "exrenew", o->version, o);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* EXUNLOCK <key> <owner> */
+int TairStringTypeExUnlock_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    long long now = RedisModule_Milliseconds();
+    TairStringObj *o = RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY ? NULL : RedisModule_ModuleTypeGetValue(key);
+    if (o == NULL || !lockIsHeld(o, now) || RedisModule_StringCompare(o->value, argv[2]) != 0) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    setLockState(ctx, argv[1], o, o->value, TAIRSTRING_LOCK_RELEASED);
+    notifyKeyModified(ctx, argv[1], "exunlock", o->version, o);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* EXLOCKSET <key> <owner> <version> <deadline>
+ *
+ * Set the lock state as is, this is what the lock commands replicate and what
+ * the AOF rewrite emits, it is not meant to be called by clients. */
+int TairStringTypeExLockSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 5) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version, deadline;
+    if (RedisModule_StringToLongLong(argv[3], &version) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[4], &deadline) != REDISMODULE_OK || version < 0 || deadline < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    } else {
+        o = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    o->version = (uint64_t)version;
+    setLockState(ctx, argv[1], o, argv[2], deadline);
+    notifyKeyModified(ctx, argv[1], "exlockset", o->version, o);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* ================================ semaphores ===============================*/
+
+/* A semaphore keeps its holders in the ext of the key and their number as the
+ * value, so EXGET shows how many permits are in use. Expired holders are
+ * reclaimed by the next acquire. Every change bumps the version and is
+ * replicated as one EXSEMSET carrying the whole holder table, which the limit
+ * keeps small. */
+static int isSemaphore(TairStringObj *o) {
+    return o->ext && o->ext->semaphore;
+}
+
+static TairStringHolder *lookupHolder(TairStringObj *o, RedisModuleString *holder) {
+    if (o->ext == NULL) return NULL;
+
+    uint32_t j;
+    for (j = 0; j < o->ext->nholders; j++) {
+        if (RedisModule_StringCompare(o->ext->holders[j].id, holder) == 0) return &o->ext->holders[j];
+    }
+    return NULL;
+}
+
+static void addHolder(TairStringObj *o, RedisModuleString *holder, long long expire_at) {
+    TairStringExt *ext = tairStringObjExt(o);
+    ext->holders = RedisModule_Realloc(ext->holders, sizeof(TairStringHolder) * (ext->nholders + 1));
+    ext->holders[ext->nholders].id = RedisModule_CreateStringFromString(NULL, holder);
+    ext->holders[ext->nholders].expire_at = expire_at;
+    ext->nholders++;
+}
+
+static void removeHolder(TairStringObj *o, TairStringHolder *h) {
+    TairStringExt *ext = o->ext;
+    RedisModule_FreeString(NULL, h->id);
+    *h = ext->holders[--ext->nholders];
+}
+
+/* Drop the holders whose permit expired, return how many were dropped. */
+static uint32_t reclaimHolders(TairStringObj *o, long long now) {
+    if (o->ext == NULL) return 0;
+
+    uint32_t j = 0, reclaimed = 0;
+    while (j < o->ext->nholders) {
+        if (o->ext->holders[j].expire_at <= now) {
+            removeHolder(o, &o->ext->holders[j]);
+            reclaimed++;
+        } else {
+            j++;
+        }
+    }
+    return reclaimed;
+}
+
+/* Store the number of holders as the value, bump the version and replicate
+ * the new state. */
+static void semaphoreChanged(RedisModuleCtx *ctx, RedisModuleString *keyname, TairStringObj *o,
+                             const char *event) {
+    uint32_t n = o->ext ? o->ext->nholders : 0, j;
+
+    if (o->value) {
+        RedisModule_FreeString(NULL, o->value);
+    }
+    o->value = RedisModule_CreateStringFromLongLong(NULL, n);
+    o->version++;
+
+    RedisModuleString **args = RedisModule_Alloc(sizeof(RedisModuleString *) * (2 + 2 * n));
+    args[0] = keyname;
+    args[1] = RedisModule_CreateStringFromLongLong(ctx, (long long)o->version);
+    for (j = 0; j < n; j++) {
+        args[2 + 2 * j] = o->ext->holders[j].id;
+        args[3 + 2 * j] = RedisModule_CreateStringFromLongLong(ctx, o->ext->holders[j].expire_at);
+    }
+    RedisModule_Replicate(ctx, "EXSEMSET", "v", args, (size_t)(2 + 2 * n));
+    RedisModule_Free(args);
+
+    notifyKeyModified(ctx, keyname, event, o->version, o);
+}
+
+/* EXSEMACQUIRE <key> <limit> <holder> <ttl_ms> */
+int TairStringTypeExSemAcquire_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 5) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long limit, ttl;
+    if (RedisModule_StringToLongLong(argv[2], &limit) != REDISMODULE_OK || limit <= 0
+        || limit > TAIRSTRING_SEM_MAX_LIMIT) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SEM_LIMIT);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], argv[4], &ttl);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    long long now = RedisModule_Milliseconds();
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+        tairStringObjExt(o)->semaphore = 1;
+    } else {
+        o = RedisModule_ModuleTypeGetValue(key);
+        /* Never take over ordinary data. */
+        if (!isSemaphore(o)) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NOT_SEMAPHORE);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    int changed = reclaimHolders(o, now) != 0, acquired = 1;
+    TairStringHolder *h = lookupHolder(o, argv[3]);
+    if (h) {
+        /* Acquiring again as a holder renews its permit. */
+        h->expire_at = now + ttl;
+        changed = 1;
+    } else if ((o->ext ? o->ext->nholders : 0) < (uint32_t)limit) {
+        addHolder(o, argv[3], now + ttl);
+        changed = 1;
+    } else {
+        acquired = 0;
+    }
+
+    if (changed) {
+        semaphoreChanged(ctx, argv[1], o, "exsemacquire");
+    }
+    RedisModule_ReplyWithLongLong(ctx, acquired);
+    return REDISMODULE_OK;
+}
+
+/* EXSEMRELEASE <key> <holder> */
+int TairStringTypeExSemRelease_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    long long now = RedisModule_Milliseconds();
+    TairStringObj *o = RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY ? NULL : RedisModule_ModuleTypeGetValue(key);
+    TairStringHolder *h = o ? lookupHolder(o, argv[2]) : NULL;
+    if (h == NULL || h->expire_at <= now) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    removeHolder(o, h);
+    semaphoreChanged(ctx, argv[1], o, "exsemrelease");
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    return REDISMODULE_OK;
+}
+
+/* EXSEMSET <key> <version> [<holder> <expire_at> ...]
+ *
+ * Replace the holder table as is, this is what the semaphore commands
+ * replicate and what the AOF rewrite emits, it is not meant to be called by
+ * clients. */
+int TairStringTypeExSemSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc < 3 || argc % 2 != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version, expire_at;
+    int j;
+    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK || version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+    for (j = 4; j < argc; j += 2) {
+        if (RedisModule_StringToLongLong(argv[j], &expire_at) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    } else {
+        o = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    tairStringObjExt(o)->semaphore = 1;
+    while (o->ext && o->ext->nholders) {
+        removeHolder(o, &o->ext->holders[0]);
+    }
+    for (j = 3; j < argc; j += 2) {
+        RedisModule_StringToLongLong(argv[j + 1], &expire_at);
+        addHolder(o, argv[j], expire_at);
+    }
+
+    /* semaphoreChanged() bumps the version back to the given one. */
+    o->version = (uint64_t)version - 1;
+    semaphoreChanged(ctx, argv[1], o, "exsemset");
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* =============================== rate limiter ==============================*/
+
+/* EXRATELIMIT <key> <rate> <burst> [COST cost]
+ *
+ * Generic cell rate algorithm: each request of cost n pushes the theoretical
+ * arrival time (TAT) of the key n emission intervals (1s / rate) further, and
+ * is allowed while the TAT stays within burst intervals of now. The TAT is
+ * stored in microseconds as the value, and the key expires once it is reached
+ * since an empty key then means the same thing. The key is marked as a rate
+ * limiter, other keys are refused. Replies with whether the request is
+ * allowed, the remaining budget, and the milliseconds to wait before
+ * retrying (-1 if allowed). */
+int TairStringTypeExRateLimit_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 4 && argc != 6) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long rate, burst, cost = 1;
+    if (RedisModule_StringToLongLong(argv[2], &rate) != REDISMODULE_OK || rate <= 0
+        || rate > TAIRSTRING_RATELIMIT_MAX_RATE || RedisModule_StringToLongLong(argv[3], &burst) != REDISMODULE_OK
+        || burst <= 0 || burst > TAIRSTRING_RATELIMIT_MAX_BURST) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_RATELIMIT);
+        return REDISMODULE_ERR;
+    }
+    if (argc == 6
+        && (mstringcasecmp(argv[4], "cost") || RedisModule_StringToLongLong(argv[5], &cost) != REDISMODULE_OK
+            || cost < 0 || cost > TAIRSTRING_RATELIMIT_MAX_BURST)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    long long now_ms = RedisModule_Milliseconds(), now = now_ms * 1000, tat = now;
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+        o = RedisModule_ModuleTypeGetValue(key);
+        /* Never take over ordinary data. */
+        if (o->ext == NULL || !o->ext->ratelimiter) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NOT_RATELIMIT);
+            return REDISMODULE_ERR;
+        }
+        if (RedisModule_StringToLongLong(o->value, &tat) != REDISMODULE_OK || tat < 0 || tat > LLONG_MAX / 2) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+            return REDISMODULE_ERR;
+        }
+        if (tat < now) tat = now;
+    }
+
+    long long interval = 1000000 / rate, tolerance = interval * burst;
+    long long new_tat = tat + interval * cost, allow_at = new_tat - tolerance;
+
+    RedisModule_ReplyWithArray(ctx, 3);
+    if (allow_at > now) {
+        long long remaining = (now + tolerance - tat) / interval;
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        RedisModule_ReplyWithLongLong(ctx, remaining < 0 ? 0 : remaining);
+        RedisModule_ReplyWithLongLong(ctx, (allow_at - now + 999) / 1000);
+        return REDISMODULE_OK;
+    }
+
+    /* COST 0 only peeks at the budget. */
+    if (cost > 0) {
+        if (o == NULL) {
+            o = createTairStringTypeObject();
+            RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+        } else {
+            historyRecord(o);
+            dropValueState(o);
+            RedisModule_FreeString(NULL, o->value);
+        }
+        o->value = RedisModule_CreateStringFromLongLong(NULL, new_tat);
+        o->version++;
+        tairStringObjExt(o)->ratelimiter = 1;
+
+        long long expire_at = now_ms + (new_tat - now + 999) / 1000;
+        RedisModule_SetExpire(key, expire_at - now_ms);
+        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], o->value, "ABS", o->version, "PXAT", expire_at);
+        RedisModule_Replicate(ctx, "EXRATESET", "s", argv[1]);
+        replicateTags(ctx, argv[1], o);
+        notifyKeyModified(ctx, argv[1], "exratelimit", o->version, o);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    RedisModule_ReplyWithLongLong(ctx, (now + tolerance - new_tat) / interval);
+    RedisModule_ReplyWithLongLong(ctx, -1);
+    return REDISMODULE_OK;
+}
+
+/* EXRATESET <key>
+ *
+ * Mark key as a rate limiter, this is what EXRATELIMIT replicates after the
+ * EXSET of the TAT and what the AOF rewrite emits, it is not meant to be
+ * called by clients. */
+int TairStringTypeExRateSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    tairStringObjExt(RedisModule_ModuleTypeGetValue(key))->ratelimiter = 1;
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* ============================ windowed counters ============================*/
+
+/* Parse a duration such as 1500, 1500ms, 60s, 5m or 1h into milliseconds. */
+static int mstring2duration(RedisModuleString *val, long long *ms) {
+    size_t len, digits;
+    const char *ptr = RedisModule_StringPtrLen(val, &len);
+    long long unit = 1, v;
+
+    for (digits = 0; digits < len && isdigit((unsigned char)ptr[digits]); digits++)
+        ;
+    const char *suffix = ptr + digits;
+    size_t slen = len - digits;
+    if (slen == 0 || (slen == 2 && !strncasecmp(suffix, "ms", 2))) {
+        unit = 1;
+    } else if (slen == 1 && (*suffix == 's' || *suffix == 'S')) {
+        unit = 1000;
+    } else if (slen == 1 && (*suffix == 'm' || *suffix == 'M')) {
+        unit = 60 * 1000;
+    } else if (slen == 1 && (*suffix == 'h' || *suffix == 'H')) {
+        unit = 3600 * 1000;
+    } else {
+        return REDISMODULE_ERR;
+    }
+
+    if (!m_string2ll(ptr, digits, &v) || v <= 0 || v > LLONG_MAX / unit) return REDISMODULE_ERR;
+    *ms = v * unit;
+    return REDISMODULE_OK;
+}
+
+/* Bucket epoch e counts the events of [e * bucket_ms, (e + 1) * bucket_ms)
+ * and lives in counts[e % nbuckets], so the ring is rotated by clearing the
+ * buckets between the newest epoch and the current one, without moving
+ * anything. The value of the key is the total of the window as of the newest
+ * epoch. */
+static TairStringWindow *createWindow(TairStringObj *o, long long bucket_ms, uint32_t nbuckets) {
+    TairStringWindow *w = RedisModule_Calloc(1, sizeof(*w));
+    w->bucket_ms = bucket_ms;
+    w->nbuckets = nbuckets;
+    w->counts = RedisModule_Calloc(nbuckets, sizeof(long long));
+    tairStringObjExt(o)->window = w;
+    return w;
+}
+
+/* Make epoch the newest bucket, clearing the ones that left the window. */
+static void rotateWindow(TairStringWindow *w, long long epoch) {
+    long long e;
+    if (epoch <= w->head) return;
+    if (epoch - w->head >= w->nbuckets) {
+        memset(w->counts, 0, sizeof(long long) * w->nbuckets);
+    } else {
+        for (e = w->head + 1; e <= epoch; e++) {
+            w->counts[e % w->nbuckets] = 0;
+        }
+    }
+    w->head = epoch;
+}
+
+/* Sum the last nbuckets buckets as seen from epoch, without rotating. */
+static long long windowSum(TairStringWindow *w, long long epoch, long long nbuckets) {
+    long long e, sum = 0;
+    for (e = w->head; e > w->head - w->nbuckets && e >= 0; e--) {
+        if (e <= epoch - nbuckets) break;
+        if (e <= epoch) sum += w->counts[e % w->nbuckets];
+    }
+    return sum;
+}
+
+/* Store the total of the window as the value, bump or set the version, set
+ * the expire to the time the newest bucket leaves the window, and replicate
+ * the bucket of epoch as is. */
+static void windowChanged(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *keyname, TairStringObj *o,
+                          long long epoch, const char *event) {
+    TairStringWindow *w = o->ext->window;
+
+    if (o->value) {
+        RedisModule_FreeString(NULL, o->value);
+    }
+    o->value = RedisModule_CreateStringFromLongLong(NULL, windowSum(w, w->head, w->nbuckets));
+
+    long long expire = (w->head + w->nbuckets) * w->bucket_ms - RedisModule_Milliseconds();
+    RedisModule_SetExpire(key, expire > 0 ? expire : 0);
+
+    RedisModule_Replicate(ctx, "EXWBUCKETSET", "slllll", keyname, (long long)o->version, w->bucket_ms,
+                          (long long)w->nbuckets, epoch, w->counts[epoch % w->nbuckets]);
+    notifyKeyModified(ctx, keyname, event, o->version, o);
+}
+
+/* Open the windowed counter at key, replying with an error and returning
+ * NULL if key holds something else. */
+static RedisModuleKey *openWindowKey(RedisModuleCtx *ctx, RedisModuleString *keyname, int mode, TairStringObj **o) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, mode);
+    *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) return key;
+
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return NULL;
+    }
+    *o = RedisModule_ModuleTypeGetValue(key);
+    if ((*o)->ext == NULL || (*o)->ext->window == NULL) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NOT_WINDOW);
+        return NULL;
+    }
+    return key;
+}
+
+/* EXWINCRBY <key> <delta> WINDOW <window> BUCKET <bucket> */
+int TairStringTypeExWIncrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 7) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long delta, window = 0, bucket = 0;
+    int j;
+    if (RedisModule_StringToLongLong(argv[2], &delta) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
+        return REDISMODULE_ERR;
+    }
+    for (j = 3; j < argc; j += 2) {
+        if (!mstringcasecmp(argv[j], "window") && mstring2duration(argv[j + 1], &window) == REDISMODULE_OK) {
+            continue;
+        } else if (!mstringcasecmp(argv[j], "bucket") && mstring2duration(argv[j + 1], &bucket) == REDISMODULE_OK) {
+            continue;
+        }
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+    if (window == 0 || bucket == 0 || window % bucket || window / bucket > TAIRSTRING_WINDOW_MAX_BUCKETS) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_WINDOW);
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *o;
+    RedisModuleKey *key = openWindowKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, &o);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    uint32_t nbuckets = (uint32_t)(window / bucket);
+    TairStringWindow *w = NULL;
+    if (o == NULL) {
+        o = createTairStringTypeObject();
+        w = createWindow(o, bucket, nbuckets);
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    } else {
+        w = o->ext->window;
+        if (w->bucket_ms != bucket || w->nbuckets != nbuckets) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_WINDOW_MISMATCH);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    long long epoch = RedisModule_Milliseconds() / bucket;
+    rotateWindow(w, epoch);
+    long long *count = &w->counts[epoch % nbuckets], total = windowSum(w, epoch, nbuckets);
+    if ((delta < 0 && (*count < LLONG_MIN - delta || total < LLONG_MIN - delta))
+        || (delta > 0 && (*count > LLONG_MAX - delta || total > LLONG_MAX - delta))) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+        return REDISMODULE_ERR;
+    }
+    *count += delta;
+    o->version++;
+
+    windowChanged(ctx, key, argv[1], o, epoch, "exwincrby");
+    RedisModule_ReplyWithLongLong(ctx, total + delta);
+    return REDISMODULE_OK;
+}
+
+/* EXWCOUNT <key> [RANGE range] */
+int TairStringTypeExWCount_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 2 && argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long range = 0;
+    if (argc == 4 && (mstringcasecmp(argv[2], "range") || mstring2duration(argv[3], &range) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *o;
+    RedisModuleKey *key = openWindowKey(ctx, argv[1], REDISMODULE_READ, &o);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    } else if (o == NULL) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    /* A range is rounded up to whole buckets and capped to the window. */
+    TairStringWindow *w = o->ext->window;
+    long long nbuckets = range ? (range + w->bucket_ms - 1) / w->bucket_ms : w->nbuckets;
+    if (nbuckets > w->nbuckets) nbuckets = w->nbuckets;
+    RedisModule_ReplyWithLongLong(ctx, windowSum(w, RedisModule_Milliseconds() / w->bucket_ms, nbuckets));
+    return REDISMODULE_OK;
+}
+
+/* EXWBUCKETSET <key> <version> <bucket_ms> <nbuckets> <epoch> <count>
+ *
+ * Set one bucket of a windowed counter as is, this is what EXWINCRBY
+ * replicates and what the AOF rewrite emits, it is not meant to be called by
+ * clients. */
+int TairStringTypeExWBucketSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc != 7) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long version, bucket, nbuckets, epoch, count;
+    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[3], &bucket) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[4], &nbuckets) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[5], &epoch) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[6], &count) != REDISMODULE_OK || version < 0 || bucket <= 0
+        || nbuckets <= 0 || nbuckets > TAIRSTRING_WINDOW_MAX_BUCKETS || epoch < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    /* The AOF rewrite emits an EXSET before the buckets, so the window is
+     * also added to a plain key. */
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    } else {
+        o = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    TairStringWindow *w = o->ext ? o->ext->window : NULL;
+    if (w == NULL) {
+        w = createWindow(o, bucket, (uint32_t)nbuckets);
+    } else if (w->bucket_ms != bucket || w->nbuckets != nbuckets) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_WINDOW_MISMATCH);
+        return REDISMODULE_ERR;
+    }
+
+    /* A bucket older than the window has nothing left to set. */
+    if (epoch <= w->head - w->nbuckets) {
+        RedisModule_ReplyWithSimpleString(ctx, "OK");
+        return REDISMODULE_OK;
+    }
+    rotateWindow(w, epoch);
+    w->counts[epoch % w->nbuckets] = count;
+    o->version = (uint64_t)version;
+
+    windowChanged(ctx, key, argv[1], o, epoch, "exwbucketset");
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* ================================= vectors =================================*/
+
+/* A vector is a fixed width numeric array kept in the ext of the key, the
+ * value of the key being empty. Elements past the end read as 0 and writes
+ * grow the vector as needed. */
+static const char *TairStringVectorTypes[] = {"int32", "int64", "float"};
+
+static size_t vectorElemSize(int type) {
+    return type == TAIRSTRING_VECTOR_INT64 ? sizeof(int64_t) : sizeof(int32_t);
+}
+
+static int mstring2vectortype(RedisModuleString *val, int *type) {
+    int j;
+    for (j = 0; j <= TAIRSTRING_VECTOR_FLOAT; j++) {
+        if (!mstringcasecmp(val, TairStringVectorTypes[j])) {
+            *type = j;
+            return REDISMODULE_OK;
+        }
+    }
+    return REDISMODULE_ERR;
+}
+
+static TairStringVector *createVector(TairStringObj *o, int type) {
+    TairStringVector *v = RedisModule_Calloc(1, sizeof(*v));
+    v->type = (uint8_t)type;
+    tairStringObjExt(o)->vector = v;
+    if (o->value == NULL) {
+        o->value = RedisModule_CreateString(NULL, "", 0);
+    }
+    return v;
+}
+
+/* Grow v to len elements, the new ones being 0. */
+static void resizeVector(TairStringVector *v, uint32_t len) {
+    if (len <= v->len) return;
+    size_t size = vectorElemSize(v->type);
+    v->data = RedisModule_Realloc(v->data, size * len);
+    memset((char *)v->data + size * v->len, 0, size * (len - v->len));
+    v->len = len;
+}
+
+/* Parse an element or a delta for a vector of the given type, integers into
+ * ll and floats into d. */
+static int parseVectorNumber(int type, RedisModuleString *val, long long *ll, double *d) {
+    if (type == TAIRSTRING_VECTOR_FLOAT) {
+        long double ld;
+        if (mstring2ld(val, &ld) != REDISMODULE_OK || fabsl(ld) > FLT_MAX) return REDISMODULE_ERR;
+        *d = (double)ld;
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_StringToLongLong(val, ll) != REDISMODULE_OK) return REDISMODULE_ERR;
+    if (type == TAIRSTRING_VECTOR_INT32 && (*ll < INT32_MIN || *ll > INT32_MAX)) return REDISMODULE_ERR;
+    return REDISMODULE_OK;
+}
+
+/* Add to element idx, failing without writing if the result does not fit. */
+static int vectorIncr(TairStringVector *v, uint32_t idx, long long ll, double d) {
+    if (v->type == TAIRSTRING_VECTOR_INT32) {
+        int32_t *p = (int32_t *)v->data + idx;
+        if (ll > (long long)INT32_MAX - *p || ll < (long long)INT32_MIN - *p) return REDISMODULE_ERR;
+        *p += (int32_t)ll;
+    } else if (v->type == TAIRSTRING_VECTOR_INT64) {
+        int64_t *p = (int64_t *)v->data + idx;
+        if ((ll < 0 && *p < 0 && ll < (LLONG_MIN - *p)) || (ll > 0 && *p > 0 && ll > (LLONG_MAX - *p))) {
+            return REDISMODULE_ERR;
+        }
+        *p += ll;
+    } else {
+        float *p = (float *)v->data + idx;
+        double r = (double)*p + d;
+        if (fabs(r) > FLT_MAX) return REDISMODULE_ERR;
+        *p = (float)r;
+    }
+    return REDISMODULE_OK;
+}
+
+/* Element-wise kernels of EXVADD, 16 bytes at a time with the GCC/clang
+ * vector extensions, which lower to SSE/NEON or to plain scalar code if the
+ * target has neither. The caller checked that no element overflows. */
+#if defined(__GNUC__)
+#define TAIRSTRING_VECTOR_ADD_LANES(type)                                                                      \
+    typedef type lanes_t __attribute__((vector_size(16)));                                                   \
+    for (; j + sizeof(lanes_t) / sizeof(type) <= n; j += sizeof(lanes_t) / sizeof(type)) {                   \
+        lanes_t a, b;                                                                                          \
+        memcpy(&a, dst + j, sizeof(a));                                                                        \
+        memcpy(&b, src + j, sizeof(b));                                                                        \
+        a += b;                                                                                                \
+        memcpy(dst + j, &a, sizeof(a));                                                                        \
+    }
+#else
+#define TAIRSTRING_VECTOR_ADD_LANES(type)
+#endif
+
+#define TAIRSTRING_VECTOR_ADD_KERNEL(name, type)                                                               \
+    static void name(type *dst, const type *src, uint32_t n) {                                                 \
+        uint32_t j = 0;                                                                                        \
+        TAIRSTRING_VECTOR_ADD_LANES(type)                                                                      \
+        for (; j < n; j++) dst[j] += src[j];                                                                   \
+    }
+
+TAIRSTRING_VECTOR_ADD_KERNEL(vectorAddInt32, int32_t)
+TAIRSTRING_VECTOR_ADD_KERNEL(vectorAddInt64, int64_t)
+TAIRSTRING_VECTOR_ADD_KERNEL(vectorAddFloat, float)
+
+/* Format a float with the fewest digits that still read back as the same
+ * float. */
+static int float2string(char *buf, size_t len, float f) {
+    int prec, n = 0;
+    for (prec = 6; prec <= 9; prec++) {
+        n = snprintf(buf, len, "%.*g", prec, (double)f);
+        if (strtof(buf, NULL) == f) break;
+    }
+    return n;
+}
+
+static RedisModuleString *vectorElemString(RedisModuleCtx *ctx, TairStringVector *v, uint32_t idx) {
+    if (v->type == TAIRSTRING_VECTOR_FLOAT) {
+        char buf[32];
+        int len = float2string(buf, sizeof(buf), ((float *)v->data)[idx]);
+        return RedisModule_CreateString(ctx, buf, len);
+    } else if (v->type == TAIRSTRING_VECTOR_INT32) {
+        return RedisModule_CreateStringFromLongLong(ctx, ((int32_t *)v->data)[idx]);
+    }
+    return RedisModule_CreateStringFromLongLong(ctx, ((int64_t *)v->data)[idx]);
+}
+
+static void replyWithVectorElem(RedisModuleCtx *ctx, TairStringVector *v, uint32_t idx) {
+    if (v->type == TAIRSTRING_VECTOR_FLOAT) {
+        RedisModule_ReplyWithString(ctx, vectorElemString(ctx, v, idx));
+    } else if (v->type == TAIRSTRING_VECTOR_INT32) {
+        RedisModule_ReplyWithLongLong(ctx, ((int32_t *)v->data)[idx]);
+    } else {
+        RedisModule_ReplyWithLongLong(ctx, ((int64_t *)v->data)[idx]);
+    }
+}
+
+/* Build the arguments of EXVSET for the elements idxs of v, or for its n
+ * first elements if idxs is NULL. */
+static RedisModuleString **vectorSetArgs(RedisModuleCtx *ctx, RedisModuleString *keyname, TairStringObj *o,
+                                         uint32_t *idxs, uint32_t n, size_t *argc) {
+    TairStringVector *v = o->ext->vector;
+    RedisModuleString **args = RedisModule_Alloc(sizeof(RedisModuleString *) * (4 + 2 * (size_t)n));
+    uint32_t j;
+
+    args[0] = keyname;
+    args[1] = RedisModule_CreateStringFromLongLong(ctx, (long long)o->version);
+    args[2] = RedisModule_CreateString(ctx, TairStringVectorTypes[v->type], strlen(TairStringVectorTypes[v->type]));
+    args[3] = RedisModule_CreateStringFromLongLong(ctx, v->len);
+    for (j = 0; j < n; j++) {
+        uint32_t idx = idxs ? idxs[j] : j;
+        args[4 + 2 * j] = RedisModule_CreateStringFromLongLong(ctx, idx);
+        args[5 + 2 * j] = vectorElemString(ctx, v, idx);
+    }
+    *argc = 4 + 2 * (size_t)n;
+    return args;
+}
+
+static void replicateVector(RedisModuleCtx *ctx, RedisModuleString *keyname, TairStringObj *o, uint32_t *idxs,
+                            uint32_t n) {
+    size_t argc;
+    RedisModuleString **args = vectorSetArgs(ctx, keyname, o, idxs, n, &argc);
+    RedisModule_Replicate(ctx, "EXVSET", "v", args, argc);
+    RedisModule_Free(args);
+}
+
+/* Open the vector at key, replying with an error and returning NULL if key
+ * holds something else. */
+static RedisModuleKey *openVectorKey(RedisModuleCtx *ctx, RedisModuleString *keyname, int mode, TairStringObj **o) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, mode);
+    *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) return key;
+
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return NULL;
+    }
+    *o = RedisModule_ModuleTypeGetValue(key);
+    if ((*o)->ext == NULL || (*o)->ext->vector == NULL) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NOT_VECTOR);
+        return NULL;
+    }
+    return key;
+}
+
+/* Parse the optional TYPE of EXVINCRBY/EXVADD and open the vector, returning
+ * the index of the first argument after them, or -1 after replying with an
+ * error. */
+static int openVectorForWrite(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, RedisModuleKey **key,
+                              TairStringObj **o, int *type) {
+    int start = 2;
+    *type = -1;
+    if (argc > 3 && !mstringcasecmp(argv[2], "type")) {
+        if (mstring2vectortype(argv[3], type) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VECTOR_TYPE);
+            return -1;
+        }
+        start = 4;
+    }
+
+    *key = openVectorKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, o);
+    if (*key == NULL) {
+        return -1;
+    }
+    if (*o && *type != -1 && *type != (*o)->ext->vector->type) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VECTOR_TYPE);
+        return -1;
+    }
+    if (*o) {
+        *type = (*o)->ext->vector->type;
+    } else if (*type == -1) {
+        *type = TAIRSTRING_VECTOR_INT64;
+    }
+    return start;
+}
+
+/* EXVINCRBY <key> [TYPE int32|int64|float] <idx> <delta> [<idx> <delta> ...] */
+int TairStringTypeExVIncrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModuleKey *key;
+    TairStringObj *o;
+    int type, start = openVectorForWrite(ctx, argv, argc, &key, &o, &type);
+    if (start == -1) {
+        return REDISMODULE_ERR;
+    }
+    if (argc == start || (argc - start) % 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    uint32_t n = (argc - start) / 2, j, maxlen = 0;
+    uint32_t *idxs = RedisModule_PoolAlloc(ctx, sizeof(uint32_t) * n);
+    long long *lls = RedisModule_PoolAlloc(ctx, sizeof(long long) * n);
+    double *ds = RedisModule_PoolAlloc(ctx, sizeof(double) * n);
+    for (j = 0; j < n; j++) {
+        long long idx;
+        if (RedisModule_StringToLongLong(argv[start + 2 * j], &idx) != REDISMODULE_OK || idx < 0
+            || idx >= TAIRSTRING_VECTOR_MAX_LEN) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VECTOR_INDEX);
+            return REDISMODULE_ERR;
+        }
+        if (parseVectorNumber(type, argv[start + 2 * j + 1], &lls[j], &ds[j]) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+            return REDISMODULE_ERR;
+        }
+        idxs[j] = (uint32_t)idx;
+        if (idxs[j] + 1 > maxlen) maxlen = idxs[j] + 1;
+    }
+
+    int created = o == NULL;
+    if (created) {
+        o = createTairStringTypeObject();
+        createVector(o, type);
+    }
+    TairStringVector *v = o->ext->vector;
+    uint32_t oldlen = v->len;
+    resizeVector(v, maxlen);
+
+    /* The old elements are kept so that an overflow undoes the whole
+     * command. */
+    size_t size = vectorElemSize(type);
+    char *old = RedisModule_PoolAlloc(ctx, size * n);
+    for (j = 0; j < n; j++) {
+        memcpy(old + size * j, (char *)v->data + size * idxs[j], size);
+        if (vectorIncr(v, idxs[j], lls[j], ds[j]) != REDISMODULE_OK) {
+            while (j-- > 0) {
+                memcpy((char *)v->data + size * idxs[j], old + size * j, size);
+            }
+            v->len = oldlen;
+            if (created) TairStringTypeReleaseObject(o);
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+            return REDISMODULE_ERR;
+        }
     }
 
-    if (RedisModule_StringToLongLong(argv[3], &version) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
-        return REDISMODULE_ERR;
+    if (created) {
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
     }
+    o->version++;
+    replicateVector(ctx, argv[1], o, idxs, n);
+    notifyKeyModified(ctx, argv[1], "exvincrby", o->version, o);
 
-    if ((expire_p && expire <=0) || version < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    RedisModule_ReplyWithArray(ctx, n);
+    for (j = 0; j < n; j++) {
+        replyWithVectorElem(ctx, v, idxs[j]);
     }
+    return REDISMODULE_OK;
+}
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-        return REDISMODULE_ERR;
-    }
+/* EXVADD <key> [TYPE int32|int64|float] <delta> [<delta> ...]
+ *
+ * Add the deltas element-wise, the first one to element 0. */
+int TairStringTypeExVAdd_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
 
-    TairStringObj *tair_string_obj = NULL;
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithLongLong(ctx, -1);
-        return REDISMODULE_OK;
-    } else {
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
     }
 
-    if (tair_string_obj->version != version) {
-        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-        /* Here we can not use RedisModule_ReplyWithError directly, because this
-        will cause jedis throw an exception, and the client can not read the
-        later version and value. */
-        RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_VERSION);
-        RedisModule_ReplyWithString(ctx, tair_string_obj->value);
-        RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
-        RedisModule_ReplySetArrayLength(ctx, 3);
+    RedisModuleKey *key;
+    TairStringObj *o;
+    int type, start = openVectorForWrite(ctx, argv, argc, &key, &o, &type);
+    if (start == -1) {
         return REDISMODULE_ERR;
     }
-
-    if (tair_string_obj->value) {
-        RedisModule_FreeString(ctx, tair_string_obj->value);
-        tair_string_obj->value = NULL;
+    if (argc == start) {
+        return RedisModule_WrongArity(ctx);
+    }
+    if (argc - start > TAIRSTRING_VECTOR_MAX_LEN) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VECTOR_INDEX);
+        return REDISMODULE_ERR;
     }
-    tair_string_obj->value = argv[2];
-    RedisModule_RetainString(NULL, argv[2]);
-    tair_string_obj->version++;
 
-    if (expire_p) {
-        if (ex_flags & TAIR_STRING_SET_EX) {
-            expire *= 1000;
+    uint32_t n = argc - start, j;
+    size_t size = vectorElemSize(type);
+    void *deltas = RedisModule_PoolAlloc(ctx, size * n);
+    for (j = 0; j < n; j++) {
+        long long ll;
+        double d;
+        if (parseVectorNumber(type, argv[start + j], &ll, &d) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+            return REDISMODULE_ERR;
         }
-        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
-            milliseconds = expire - RedisModule_Milliseconds();
-            if (milliseconds < 0) {
-                milliseconds = 0;
-            }
+        if (type == TAIRSTRING_VECTOR_INT32) {
+            ((int32_t *)deltas)[j] = (int32_t)ll;
+        } else if (type == TAIRSTRING_VECTOR_INT64) {
+            ((int64_t *)deltas)[j] = ll;
         } else {
-            milliseconds = expire;
+            ((float *)deltas)[j] = (float)d;
         }
+    }
 
-        RedisModule_SetExpire(key, milliseconds);
-    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
-        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+    /* Check every element before touching any, so that the kernels run
+     * without branches. */
+    TairStringVector *v = o ? o->ext->vector : NULL;
+    for (j = 0; v && j < n && j < v->len; j++) {
+        int overflow;
+        if (type == TAIRSTRING_VECTOR_INT32) {
+            long long r = (long long)((int32_t *)v->data)[j] + ((int32_t *)deltas)[j];
+            overflow = r < INT32_MIN || r > INT32_MAX;
+        } else if (type == TAIRSTRING_VECTOR_INT64) {
+            int64_t a = ((int64_t *)v->data)[j], b = ((int64_t *)deltas)[j];
+            overflow = (b < 0 && a < 0 && b < (LLONG_MIN - a)) || (b > 0 && a > 0 && b > (LLONG_MAX - a));
+        } else {
+            overflow = fabs((double)((float *)v->data)[j] + ((float *)deltas)[j]) > FLT_MAX;
+        }
+        if (overflow) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_OVERFLOW);
+            return REDISMODULE_ERR;
+        }
     }
 
-    if (expire_p) {
-        RedisModule_Replicate(ctx, "EXSET", "ssclcl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version,
-                              "PXAT", (milliseconds + RedisModule_Milliseconds()));
+    if (o == NULL) {
+        o = createTairStringTypeObject();
+        v = createVector(o, type);
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
+    }
+    resizeVector(v, n);
+    if (type == TAIRSTRING_VECTOR_INT32) {
+        vectorAddInt32(v->data, deltas, n);
+    } else if (type == TAIRSTRING_VECTOR_INT64) {
+        vectorAddInt64(v->data, deltas, n);
     } else {
-        RedisModule_Replicate(ctx, "EXSET", "sscl", argv[1], tair_string_obj->value, "ABS", tair_string_obj->version);
+        vectorAddFloat(v->data, deltas, n);
     }
 
-    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-    RedisModule_ReplyWithSimpleString(ctx, "OK");
-    RedisModule_ReplyWithSimpleString(ctx, "");
-    RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
-    RedisModule_ReplySetArrayLength(ctx, 3);
+    o->version++;
+    replicateVector(ctx, argv[1], o, NULL, n);
+    notifyKeyModified(ctx, argv[1], "exvadd", o->version, o);
+    RedisModule_ReplyWithLongLong(ctx, v->len);
     return REDISMODULE_OK;
 }
 
-/* EXCAD <key> <version> */
-int TairStringTypeExCad_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXVGET <key> [<start> <end>] */
+int TairStringTypeExVGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc != 3) {
+    if (argc != 2 && argc != 4) {
         return RedisModule_WrongArity(ctx);
     }
 
-    long long version = 0;
-
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairStringType) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    long long start = 0, end = -1;
+    if (argc == 4
+        && (RedisModule_StringToLongLong(argv[2], &start) != REDISMODULE_OK
+            || RedisModule_StringToLongLong(argv[3], &end) != REDISMODULE_OK)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_NO_INT);
         return REDISMODULE_ERR;
     }
 
-    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+    TairStringObj *o;
+    RedisModuleKey *key = openVectorKey(ctx, argv[1], REDISMODULE_READ, &o);
+    if (key == NULL) {
         return REDISMODULE_ERR;
     }
 
-    TairStringObj *tair_string_obj = NULL;
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithLongLong(ctx, -1);
+    /* Same range semantics as GETRANGE/LRANGE. */
+    long long len = o ? o->ext->vector->len : 0, j;
+    if (start < 0) start += len;
+    if (end < 0) end += len;
+    if (start < 0) start = 0;
+    if (end >= len) end = len - 1;
+    if (start > end || len == 0) {
+        RedisModule_ReplyWithArray(ctx, 0);
         return REDISMODULE_OK;
-    } else {
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
     }
 
-    if (tair_string_obj->version != version) {
-        RedisModule_ReplyWithLongLong(ctx, 0);
-        return REDISMODULE_OK;
+    RedisModule_ReplyWithArray(ctx, end - start + 1);
+    for (j = start; j <= end; j++) {
+        replyWithVectorElem(ctx, o->ext->vector, (uint32_t)j);
     }
-
-    RedisModule_Replicate(ctx, "DEL", "s", argv[1]);
-    RedisModule_DeleteKey(key);
-    RedisModule_ReplyWithLongLong(ctx, 1);
     return REDISMODULE_OK;
 }
 
-/* CAD <key> <value> */
-int StringTypeCad_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXVSET <key> <version> <type> <len> [<idx> <value> ...]
+ *
+ * Set elements of a vector as is, this is what the vector commands replicate
+ * and what the AOF rewrite emits, it is not meant to be called by clients. */
+int TairStringTypeExVSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc != 3) {
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
+
+    if (argc < 5 || argc % 2 != 1) {
         return RedisModule_WrongArity(ctx);
     }
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && type != REDISMODULE_KEYTYPE_STRING) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    long long version, len, idx, ll;
+    double d;
+    int type, j;
+    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK || version < 0
+        || mstring2vectortype(argv[3], &type) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[4], &len) != REDISMODULE_OK || len < 0
+        || len > TAIRSTRING_VECTOR_MAX_LEN) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
+    for (j = 5; j < argc; j += 2) {
+        if (RedisModule_StringToLongLong(argv[j], &idx) != REDISMODULE_OK || idx < 0 || idx >= len
+            || parseVectorNumber(type, argv[j + 1], &ll, &d) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+    }
 
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithLongLong(ctx, -1);
-        return REDISMODULE_OK;
+    /* The AOF rewrite emits an EXSET before the elements, so the vector is
+     * also added to a plain key. */
+    RedisModuleKey *key = openWritableKey(ctx, argv[1], NULL, NULL);
+    if (key == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    TairStringObj *o = NULL;
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        o = createTairStringTypeObject();
+        RedisModule_ModuleTypeSetValue(key, TairStringType, o);
     } else {
-        size_t proto_len, expect_len;
-        RedisModuleCallReply *replay = RedisModule_Call(ctx, "GET", "s", argv[1]);
-        switch (RedisModule_CallReplyType(replay)) {
-            case REDISMODULE_REPLY_STRING:
-                break;
-            default:
-                RedisModule_ReplyWithLongLong(ctx, 0);
-                return REDISMODULE_OK;
-        }
-
-        const char *proto_ptr = RedisModule_CallReplyStringPtr(replay, &proto_len);
-        const char *expect_ptr = RedisModule_StringPtrLen(argv[2], &expect_len);
-        if (proto_len != expect_len || memcmp(expect_ptr, proto_ptr, proto_len) != 0) {
-            RedisModule_ReplyWithLongLong(ctx, 0);
-            return REDISMODULE_OK;
+        o = RedisModule_ModuleTypeGetValue(key);
+    }
+
+    TairStringVector *v = o->ext ? o->ext->vector : NULL;
+    if (v == NULL) {
+        v = createVector(o, type);
+    } else if (v->type != type) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VECTOR_TYPE);
+        return REDISMODULE_ERR;
+    }
+
+    resizeVector(v, (uint32_t)len);
+    for (j = 5; j < argc; j += 2) {
+        RedisModule_StringToLongLong(argv[j], &idx);
+        parseVectorNumber(type, argv[j + 1], &ll, &d);
+        if (type == TAIRSTRING_VECTOR_INT32) {
+            ((int32_t *)v->data)[idx] = (int32_t)ll;
+        } else if (type == TAIRSTRING_VECTOR_INT64) {
+            ((int64_t *)v->data)[idx] = ll;
+        } else {
+            ((float *)v->data)[idx] = (float)d;
         }
     }
+    o->version = (uint64_t)version;
 
-    RedisModule_DeleteKey(key);
-    RedisModule_Replicate(ctx, "DEL", "s", argv[1]);
-    RedisModule_ReplyWithLongLong(ctx, 1);
+    RedisModule_ReplicateVerbatim(ctx);
+    notifyKeyModified(ctx, argv[1], "exvset", o->version, o);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
     return REDISMODULE_OK;
 }
 
-/* CAS <Key> <oldvalue> <newvalue> [EX/EXAT/PX/PXAT time] [KEEPTTL] */
-int StringTypeCas_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXWAIT <key> <known_version> <timeout_ms> */
+int TairStringTypeExWait_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc < 4) {
+    if (argc != 4) {
         return RedisModule_WrongArity(ctx);
     }
 
-    long long milliseconds = 0, expire = 0;
-    RedisModuleString *expire_p = NULL;
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | TAIR_STRING_SET_ABS_EXPIRE | TAIR_STRING_SET_KEEPTTL;
-    if (parseAndGetExFlags(argv, argc, 4, &ex_flags, &expire_p, NULL, NULL, NULL, NULL, NULL, allow_flags) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+    long long version = 0, timeout = 0;
+    if (RedisModule_StringToLongLong(argv[2], &version) != REDISMODULE_OK || version < 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
         return REDISMODULE_ERR;
     }
 
-    if ((expire_p && expire <=0)) {
+    if (RedisModule_StringToLongLong(argv[3], &timeout) != REDISMODULE_OK || timeout < 0) {
         RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
     int type = RedisModule_KeyType(key);
-    if (REDISMODULE_KEYTYPE_EMPTY != type && type != REDISMODULE_KEYTYPE_STRING) {
-        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-        return REDISMODULE_ERR;
+    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
     }
 
     if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithLongLong(ctx, -1);
-        return REDISMODULE_OK;
+        /* A caller that knows a version has seen the key, so it has been
+         * deleted since. Version 0 means waiting for the key to be created. */
+        if (version != 0) {
+            return RedisModule_ReplyWithNull(ctx);
+        }
     } else {
-        size_t proto_len, expect_len;
-        RedisModuleCallReply *replay = RedisModule_Call(ctx, "GET", "s", argv[1]);
-        switch (RedisModule_CallReplyType(replay)) {
-            case REDISMODULE_REPLY_STRING:
-                break;
-            default:
-                RedisModule_ReplyWithLongLong(ctx, 0);
-                return REDISMODULE_OK;
-        }
-
-        const char *proto_ptr = RedisModule_CallReplyStringPtr(replay, &proto_len);
-        const char *expect_ptr = RedisModule_StringPtrLen(argv[2], &expect_len);
-        if (proto_len != expect_len || memcmp(expect_ptr, proto_ptr, proto_len) != 0) {
-            RedisModule_ReplyWithLongLong(ctx, 0);
+        TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+        if (isLeasePlaceholder(o) && version != 0) {
+            return RedisModule_ReplyWithNull(ctx);
+        } else if (o->version != (uint64_t)version) {
+            replyWithTairStringObj(ctx, o, 0, -1);
             return REDISMODULE_OK;
         }
     }
 
-    if (RedisModule_StringSet(key, argv[3]) != REDISMODULE_OK) {
-        return REDISMODULE_ERR;
-    }
-
-    if (expire_p) {
-        if (ex_flags & TAIR_STRING_SET_EX) {
-            expire *= 1000;
-        }
-        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
-            milliseconds = expire - RedisModule_Milliseconds();
-            if (milliseconds < 0) {
-                milliseconds = 0;
-            }
-        } else {
-            milliseconds = expire;
-        }
-
-        RedisModule_SetExpire(key, milliseconds);
-    } else if (!(ex_flags & TAIR_STRING_SET_KEEPTTL)) {
-        RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
-    }
-
-    RedisModule_Replicate(ctx, "SET", "ss", argv[1], argv[3]);
-    if (expire_p) {
-        RedisModule_Replicate(ctx, "PEXPIREAT", "sl", argv[1], (milliseconds + RedisModule_Milliseconds()));
+    /* Blocking is not possible inside MULTI or scripts, behave as if the
+     * timeout was already reached, just like the native blocking commands. */
+    if (RedisModule_GetContextFlags(ctx) & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA)) {
+        return RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_TIMEOUT);
     }
 
-    RedisModule_ReplyWithLongLong(ctx, 1);
+    RedisModuleBlockedClient *bc =
+        RedisModule_BlockClient(ctx, waitReplyCallback, waitTimeoutCallback, waitFreePrivdata, timeout);
+    RedisModule_SetDisconnectCallback(bc, waitDisconnectCallback);
+    addWaiter(ctx, argv[1], bc, (uint64_t)version);
     return REDISMODULE_OK;
 }
 
-/* EXPREPEND <key> <value> [NX|XX] [VER/ABS version] */
-int TairStringTypeExPrepend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXCHANGES <since_seq> [COUNT count] */
+int TairStringTypeExChanges_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc < 3) {
+    if (argc != 2 && argc != 4) {
         return RedisModule_WrongArity(ctx);
     }
 
-    RedisModuleString *version_p = NULL;
-    long long version = 0;
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER;
-    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, NULL, &version_p, NULL, NULL, NULL, NULL, allow_flags) != REDISMODULE_OK) {
+    long long since = 0, count = 100;
+    if (RedisModule_StringToLongLong(argv[1], &since) != REDISMODULE_OK || since < 0) {
         RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    if (argc == 4) {
+        if (mstringcasecmp(argv[2], "count") || RedisModule_StringToLongLong(argv[3], &count) != REDISMODULE_OK
+            || count <= 0) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
     }
 
-    if (version < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+    if (TairStringChangeLog.size == 0) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_CHANGELOG_DISABLED);
         return REDISMODULE_ERR;
     }
 
-    size_t originalLength;
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    RedisModuleString *newvalue;
-    int type = RedisModule_KeyType(key);
+    uint64_t last_seq = TairStringChangeLog.next_seq - 1;
+    uint64_t oldest_seq = TairStringChangeLog.len ? TairStringChangeLog.entries[TairStringChangeLog.head].seq
+                                                  : TairStringChangeLog.next_seq;
+    /* Changes after since have already been dropped from the ring, or since
+     * was handed out by another run or another node. */
+    if ((uint64_t)since + 1 < oldest_seq || (uint64_t)since > last_seq) {
+        RedisModule_ReplyWithArray(ctx, 3);
+        RedisModule_ReplyWithSimpleString(ctx, TAIRSTRING_STATUSMSG_RESYNC);
+        RedisModule_ReplyWithLongLong(ctx, (long long)last_seq);
+        RedisModule_ReplyWithArray(ctx, 0);
+        return REDISMODULE_OK;
+    }
 
-    TairStringObj *tair_string_obj = NULL;
+    size_t start = (size_t)((uint64_t)since + 1 - oldest_seq);
+    size_t n = TairStringChangeLog.len - start;
+    if (n > (size_t)count) n = (size_t)count;
 
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        /* not exist: result = argv[2] */
-        if (ex_flags & TAIR_STRING_SET_XX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
-        tair_string_obj = createTairStringTypeObject();
-        tair_string_obj->value = argv[2];
-        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
-        RedisModule_RetainString(ctx, argv[2]);
-    } else {
-        /* exist: result = argv[2] + original */
-        /* Statements like "tair_string_obj->value = argv[2];
-        Append(tair_string_obj->value, original);" would lead to a mistake when
-        replicating the command from master to slave, so it's necessary to
-        create a copy of argv[2] and use the copy to get the command executed.
-      */
+    RedisModule_ReplyWithArray(ctx, 3);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    RedisModule_ReplyWithLongLong(ctx, (long long)((uint64_t)since + n));
+    RedisModule_ReplyWithArray(ctx, n);
+    size_t i;
+    for (i = start; i < start + n; i++) {
+        TairStringChange *c = &TairStringChangeLog.entries[(TairStringChangeLog.head + i) % TairStringChangeLog.size];
+        RedisModule_ReplyWithArray(ctx, 5);
+        RedisModule_ReplyWithLongLong(ctx, (long long)c->seq);
+        RedisModule_ReplyWithLongLong(ctx, c->dbid);
+        RedisModule_ReplyWithString(ctx, c->key);
+        RedisModule_ReplyWithLongLong(ctx, (long long)c->version);
+        RedisModule_ReplyWithCString(ctx, c->op);
+    }
+    return REDISMODULE_OK;
+}
 
-        if (ex_flags & TAIR_STRING_SET_NX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
+/* ================================== tags ===================================*/
 
-        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
-            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-            return REDISMODULE_ERR;
-        }
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+/* EXTAGSET <key> <tag> [<tag> ...]
+ *
+ * Set the tags of key, this is what EXSET ... TAGS replicates and what the
+ * AOF rewrite emits, it is not meant to be called by clients. */
+int TairStringTypeExTagSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
 
-        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
-            return REDISMODULE_ERR;
-        }
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
 
-        /* Convert RedisModuleString to cstring to use StringAppendBuffer() */
-        const char *c_string_original = RedisModule_StringPtrLen(tair_string_obj->value, &originalLength);
-        newvalue = RedisModule_CreateStringFromString(ctx, argv[2]);
+    if (argc < 3 || argc - 2 > TAIRSTRING_TAGS_MAX) {
+        return RedisModule_WrongArity(ctx);
+    }
 
-        if (RedisModule_StringAppendBuffer(ctx, newvalue, c_string_original, originalLength) == REDISMODULE_ERR) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_APPENDBUFFER);
-            return REDISMODULE_ERR;
-        }
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
 
-        if (tair_string_obj->value) {
-            RedisModule_FreeString(ctx, tair_string_obj->value);
+    setTags(RedisModule_ModuleTypeGetValue(key), RedisModule_GetSelectedDb(ctx), argv[1], argv + 2, argc - 2);
+    RedisModule_ReplicateVerbatim(ctx);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
+}
+
+/* EXINVALIDATE hands the keys of a tag over to a queue that a timer drains
+ * TAIRSTRING_INVALIDATE_BATCH keys at a time, so that large tags do not
+ * block the server. The timer deletes the keys and replicates a DEL for each
+ * of them. keys maps every name to the version it had when the tag was
+ * invalidated, a key rewritten since then is kept. */
+typedef struct TairStringInvalidation {
+    int dbid;
+    RedisModuleString *tag;
+    RedisModuleDict *keys; /* name -> long long version */
+    struct TairStringInvalidation *next;
+} TairStringInvalidation;
+
+static TairStringInvalidation *TairStringInvalidationHead, *TairStringInvalidationTail;
+static int TairStringInvalidationScheduled;
+
+static void invalidateTimerCallback(RedisModuleCtx *ctx, void *data) {
+    REDISMODULE_NOT_USED(data);
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleString *names[TAIRSTRING_INVALIDATE_BATCH];
+    int budget = TAIRSTRING_INVALIDATE_BATCH;
+    while (budget > 0 && TairStringInvalidationHead) {
+        TairStringInvalidation *job = TairStringInvalidationHead;
+        RedisModule_SelectDb(ctx, job->dbid);
+
+        /* The dict can not be changed while iterating it. */
+        int j, n = 0;
+        char *name;
+        size_t namelen;
+        RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(job->keys, "^", NULL, 0);
+        while (n < budget && (name = RedisModule_DictNextC(iter, &namelen, NULL)) != NULL) {
+            names[n++] = RedisModule_CreateString(ctx, name, namelen);
+        }
+        RedisModule_DictIteratorStop(iter);
+
+        for (j = 0; j < n; j++) {
+            long long *version = NULL;
+            RedisModule_DictDel(job->keys, names[j], &version);
+            /* Skip keys that were rewritten or retagged meanwhile. */
+            RedisModuleKey *key = RedisModule_OpenKey(ctx, names[j], REDISMODULE_READ | REDISMODULE_WRITE);
+            if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) == TairStringType) {
+                TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+                if (o->version == *version && hasTag(o, job->tag)) {
+                    RedisModule_DeleteKey(key);
+                    RedisModule_Replicate(ctx, "DEL", "s", names[j]);
+                }
+            }
+            RedisModule_CloseKey(key);
+            RedisModule_Free(version);
+        }
+        budget -= n;
+
+        if (RedisModule_DictSize(job->keys) == 0) {
+            TairStringInvalidationHead = job->next;
+            if (TairStringInvalidationHead == NULL) TairStringInvalidationTail = NULL;
+            RedisModule_FreeDict(NULL, job->keys);
+            RedisModule_FreeString(NULL, job->tag);
+            RedisModule_Free(job);
         }
-
-        tair_string_obj->value = newvalue;
-        RedisModule_RetainString(NULL, newvalue);
     }
 
-    if (ex_flags & TAIR_STRING_SET_WITH_ABS_VER) {
-        tair_string_obj->version = version;
+    if (TairStringInvalidationHead) {
+        RedisModule_CreateTimer(ctx, TAIRSTRING_INVALIDATE_PERIOD, invalidateTimerCallback, NULL);
     } else {
-        tair_string_obj->version++;
+        TairStringInvalidationScheduled = 0;
     }
-
-    RedisModule_ReplicateVerbatim(ctx);
-    RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
-    return REDISMODULE_OK;
 }
 
-/* EXAPPEND <key> <value> [NX|XX] [VER/ABS version] */
-int TairStringTypeExAppend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* EXINVALIDATE <tag>
+ *
+ * Delete all keys of the current db written with EXSET ... TAGS including
+ * tag, in the background. Returns the number of keys scheduled. */
+int TairStringTypeExInvalidate_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
-    if (argc < 3) {
+
+    if (argc != 2) {
         return RedisModule_WrongArity(ctx);
     }
 
-    RedisModuleString *version_p = NULL;
-    long long version = 0;
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_NX | TAIR_STRING_SET_XX | TAIR_STRING_SET_WITH_VER | TAIR_STRING_SET_WITH_ABS_VER;
-    if (parseAndGetExFlags(argv, argc, 3, &ex_flags, NULL, &version_p, NULL, NULL, NULL, NULL, allow_flags) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    char buf[256];
+    size_t len;
+    int dbid = RedisModule_GetSelectedDb(ctx);
+    char *ikey = tagIndexKey(dbid, argv[1], buf, sizeof(buf), &len);
+    RedisModuleDict *objs = NULL, *keys = NULL;
+    pthread_mutex_lock(&TairStringTagLock);
+    RedisModule_DictDelC(TairStringTagIndex, ikey, len, &objs);
+    if (objs) {
+        /* The objects may be freed once the lock is released, keep their
+         * versions instead. */
+        char *name;
+        size_t namelen;
+        TairStringObj *o;
+        keys = RedisModule_CreateDict(NULL);
+        RedisModuleDictIter *iter = RedisModule_DictIteratorStartC(objs, "^", NULL, 0);
+        while ((name = RedisModule_DictNextC(iter, &namelen, (void **)&o)) != NULL) {
+            long long *version = RedisModule_Alloc(sizeof(*version));
+            *version = o->version;
+            RedisModule_DictSetC(keys, name, namelen, version);
+        }
+        RedisModule_DictIteratorStop(iter);
+        RedisModule_FreeDict(NULL, objs);
     }
+    pthread_mutex_unlock(&TairStringTagLock);
+    if (ikey != buf) RedisModule_Free(ikey);
 
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    if (keys == NULL) {
+        return RedisModule_ReplyWithLongLong(ctx, 0);
     }
 
-    if (version < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    TairStringInvalidation *job = RedisModule_Alloc(sizeof(*job));
+    job->dbid = dbid;
+    job->tag = RedisModule_CreateStringFromString(NULL, argv[1]);
+    job->keys = keys;
+    job->next = NULL;
+    if (TairStringInvalidationTail) {
+        TairStringInvalidationTail->next = job;
+    } else {
+        TairStringInvalidationHead = job;
     }
+    TairStringInvalidationTail = job;
 
-    size_t appendLength;
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-
-    TairStringObj *tair_string_obj = NULL;
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        /* not exist: result = argv[2] */
-        if (ex_flags & TAIR_STRING_SET_XX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
+    if (!TairStringInvalidationScheduled) {
+        TairStringInvalidationScheduled = 1;
+        RedisModule_CreateTimer(ctx, 0, invalidateTimerCallback, NULL);
+    }
+    return RedisModule_ReplyWithLongLong(ctx, (long long)RedisModule_DictSize(keys));
+}
 
-        tair_string_obj = createTairStringTypeObject();
-        tair_string_obj->value = argv[2];
-        RedisModule_ModuleTypeSetValue(key, TairStringType, tair_string_obj);
-        RedisModule_RetainString(NULL, argv[2]);
+/* ================================= history =================================*/
 
-    } else {
-        /* exist: result = original + argv[2] */
-        if (ex_flags & TAIR_STRING_SET_NX) {
-            RedisModule_ReplyWithNull(ctx);
-            return REDISMODULE_ERR;
-        }
-        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
-            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-            return REDISMODULE_ERR;
-        }
-        tair_string_obj = RedisModule_ModuleTypeGetValue(key);
+/* EXHISTSET <key> <keep_versions> <keep_for> [<version> <flags> <replaced_at> <value> ...]
+ *
+ * Set the history limits and the replaced versions of key, oldest first,
+ * this is what the AOF rewrite emits, it is not meant to be called by
+ * clients. */
+int TairStringTypeExHistSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
 
-        if (ex_flags & TAIR_STRING_SET_WITH_VER && version != 0 && version != tair_string_obj->version) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VERSION);
-            return REDISMODULE_ERR;
-        }
+    if (!internalCallAllowed(ctx)) {
+        return REDISMODULE_ERR;
+    }
 
-        /* Convert RedisModuleString to cstring to use StringAppendBuffer() */
-        const char *c_string_argv = RedisModule_StringPtrLen(argv[2], &appendLength);
+    if (argc < 4 || (argc - 4) % 4 != 0 || (argc - 4) / 4 > TAIRSTRING_HISTORY_MAX) {
+        return RedisModule_WrongArity(ctx);
+    }
 
-        if (RedisModule_StringAppendBuffer(ctx, tair_string_obj->value, c_string_argv, appendLength)
-            == REDISMODULE_ERR) {
-            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_APPENDBUFFER);
+    long long keep_versions, keep_for, version, flags, replaced_at;
+    if (RedisModule_StringToLongLong(argv[2], &keep_versions) != REDISMODULE_OK
+        || RedisModule_StringToLongLong(argv[3], &keep_for) != REDISMODULE_OK || keep_versions < 0
+        || keep_versions > TAIRSTRING_HISTORY_MAX || keep_for < 0 || keep_for > LLONG_MAX / 2
+        || (keep_versions == 0 && keep_for == 0 && argc > 4)) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_HISTORY);
+        return REDISMODULE_ERR;
+    }
+    int j;
+    for (j = 4; j < argc; j += 4) {
+        if (RedisModule_StringToLongLong(argv[j], &version) != REDISMODULE_OK || version <= 0
+            || RedisModule_StringToLongLong(argv[j + 1], &flags) != REDISMODULE_OK || flags < 0 || flags > UINT_MAX
+            || RedisModule_StringToLongLong(argv[j + 2], &replaced_at) != REDISMODULE_OK) {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
             return REDISMODULE_ERR;
         }
     }
 
-    if (ex_flags & TAIR_STRING_SET_WITH_ABS_VER) {
-        tair_string_obj->version = version;
-    } else {
-        tair_string_obj->version++;
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithNull(ctx);
+        return REDISMODULE_OK;
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
     }
 
+    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+    setHistory(o, 0, 0);
+    setHistory(o, (uint32_t)keep_versions, keep_for);
+    for (j = 4; j < argc; j += 4) {
+        RedisModule_StringToLongLong(argv[j], &version);
+        RedisModule_StringToLongLong(argv[j + 1], &flags);
+        RedisModule_StringToLongLong(argv[j + 2], &replaced_at);
+        historyAppend(o, (uint64_t)version, (uint32_t)flags, replaced_at,
+                      RedisModule_CreateStringFromString(NULL, argv[j + 3]));
+    }
+    if (historyActive(o)) {
+        historyCompact(o, RedisModule_Milliseconds());
+    }
     RedisModule_ReplicateVerbatim(ctx);
-    RedisModule_ReplyWithLongLong(ctx, tair_string_obj->version);
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
     return REDISMODULE_OK;
 }
 
-/* EXGAE <key> <EX time | EXAT time | PX time | PXAT time> */
-int TairStringTypeExGAE_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+/* ================================== scan ===================================*/
+
+/* EXSCAN <cursor> [MATCH pattern] [MINVER version] [FLAGSMASK mask] [MINSIZE size] [NOTTL] [COUNT count]
+ *
+ * Walk the keyspace with SCAN and only reply the exstrtype keys that pass
+ * every given filter, each as [key, version, flags, size, ttl]. ttl is in
+ * milliseconds, -1 for no expire. COUNT is handed to SCAN, so like SCAN a
+ * call may reply fewer keys than COUNT, even none, while the cursor is not
+ * 0 yet. */
+int TairStringTypeExScan_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc < 4) {
+    if (argc < 2) {
         return RedisModule_WrongArity(ctx);
     }
- 
-    RedisModuleString *expire_p;
-    long long expire = 0, milliseconds = 0;
-    int ex_flags = TAIR_STRING_SET_NO_FLAGS;
-    unsigned int allow_flags = TAIR_STRING_SET_EX | TAIR_STRING_SET_PX | TAIR_STRING_SET_ABS_EXPIRE;
-    if (parseAndGetExFlags(argv, argc, 2, &ex_flags, &expire_p, NULL, NULL, NULL, NULL, NULL, allow_flags) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
 
-    if (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
+    const char *pattern = NULL;
+    size_t plen = 0;
+    long long minver = 0, mask = 0, minsize = 0, count = 10;
+    int nottl = 0, j;
+    for (j = 2; j < argc; j++) {
+        int more = j + 1 < argc;
+        if (!mstringcasecmp(argv[j], "match") && more) {
+            pattern = RedisModule_StringPtrLen(argv[++j], &plen);
+        } else if (!mstringcasecmp(argv[j], "minver") && more) {
+            if (RedisModule_StringToLongLong(argv[++j], &minver) != REDISMODULE_OK || minver < 0) {
+                RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_VER_INT);
+                return REDISMODULE_ERR;
+            }
+        } else if (!mstringcasecmp(argv[j], "flagsmask") && more) {
+            if (RedisModule_StringToLongLong(argv[++j], &mask) != REDISMODULE_OK || mask < 0 || mask > UINT_MAX) {
+                RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+                return REDISMODULE_ERR;
+            }
+        } else if (!mstringcasecmp(argv[j], "minsize") && more) {
+            if (RedisModule_StringToLongLong(argv[++j], &minsize) != REDISMODULE_OK || minsize < 0) {
+                RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+                return REDISMODULE_ERR;
+            }
+        } else if (!mstringcasecmp(argv[j], "nottl")) {
+            nottl = 1;
+        } else if (!mstringcasecmp(argv[j], "count") && more) {
+            if (RedisModule_StringToLongLong(argv[++j], &count) != REDISMODULE_OK || count <= 0) {
+                RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+                return REDISMODULE_ERR;
+            }
+        } else {
+            RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
     }
 
-    if ((expire_p && expire <=0)) {
-        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_SYNTAX);
+    RedisModuleCallReply *reply = RedisModule_Call(ctx, "SCAN", "scl", argv[1], "COUNT", count);
+    if (reply == NULL) {
+        RedisModule_ReplyWithError(ctx, TAIRSTRING_ERRORMSG_EINVAL);
         return REDISMODULE_ERR;
     }
-
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_WRITE);
-    int type = RedisModule_KeyType(key);
-    if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TairStringType) {
-        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    if (RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_ARRAY) {
+        return RedisModule_ReplyWithCallReply(ctx, reply);
     }
 
-    if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        RedisModule_ReplyWithNull(ctx);
-        return REDISMODULE_OK;
-    }
+    RedisModuleCallReply *names = RedisModule_CallReplyArrayElement(reply, 1);
+    size_t i, n = RedisModule_CallReplyLength(names), matched = 0;
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithCallReply(ctx, RedisModule_CallReplyArrayElement(reply, 0));
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    for (i = 0; i < n; i++) {
+        RedisModuleCallReply *name = RedisModule_CallReplyArrayElement(names, i);
+        size_t nlen;
+        const char *nptr = RedisModule_CallReplyStringPtr(name, &nlen);
+        if (pattern && !m_stringmatchlen(pattern, (int)plen, nptr, (int)nlen, 0)) {
+            continue;
+        }
 
-    if (expire_p) {
-        if (ex_flags & TAIR_STRING_SET_EX) {
-            expire *= 1000;
+        RedisModuleString *keyname = RedisModule_CreateString(ctx, nptr, nlen);
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+        if (RedisModule_ModuleTypeGetType(key) != TairStringType) {
+            RedisModule_CloseKey(key);
+            continue;
         }
-        if (ex_flags & TAIR_STRING_SET_ABS_EXPIRE) {
-            milliseconds = expire - RedisModule_Milliseconds();
-            if (milliseconds < 0) {
-                milliseconds = 0;
-            }
-        } else {
-            milliseconds = expire;
+
+        TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
+        size_t size;
+        RedisModule_StringPtrLen(o->value, &size);
+        mstime_t ttl = RedisModule_GetExpire(key);
+        RedisModule_CloseKey(key);
+        if (isLeasePlaceholder(o) || o->version < (uint64_t)minver || (o->flags & mask) != mask
+            || size < (size_t)minsize || (nottl && ttl != REDISMODULE_NO_EXPIRE)) {
+            continue;
         }
 
-        RedisModule_SetExpire(key, milliseconds);
+        RedisModule_ReplyWithArray(ctx, 5);
+        RedisModule_ReplyWithString(ctx, keyname);
+        RedisModule_ReplyWithLongLong(ctx, (long long)o->version);
+        RedisModule_ReplyWithLongLong(ctx, o->flags);
+        RedisModule_ReplyWithLongLong(ctx, (long long)size);
+        RedisModule_ReplyWithLongLong(ctx, ttl == REDISMODULE_NO_EXPIRE ? -1 : ttl);
+        matched++;
     }
-
-    TairStringObj *o = RedisModule_ModuleTypeGetValue(key);
-
-    RedisModule_ReplicateVerbatim(ctx);
-
-    RedisModule_ReplyWithArray(ctx, 3);
-    RedisModule_ReplyWithString(ctx, o->value);
-    RedisModule_ReplyWithLongLong(ctx, o->version);
-    RedisModule_ReplyWithLongLong(ctx, (long long)o->flags);
+    RedisModule_ReplySetArrayLength(ctx, matched);
     return REDISMODULE_OK;
 }
 
 /* ========================== "exstrtype" type methods =======================*/
 void *TairStringTypeRdbLoad(RedisModuleIO *rdb, int encver) {
-    if (encver != TAIRSTRING_ENCVER_VER_1) {
+    if (encver != TAIRSTRING_ENCVER_VER_1 && encver != TAIRSTRING_ENCVER_VER_2) {
         return NULL;
     }
     TairStringObj *o = createTairStringTypeObject();
     o->version = RedisModule_LoadUnsigned(rdb);
     o->flags = RedisModule_LoadUnsigned(rdb);
     o->value = RedisModule_LoadString(rdb);
+    if (encver == TAIRSTRING_ENCVER_VER_1) {
+        return o;
+    }
+
+    uint64_t ext = RedisModule_LoadUnsigned(rdb);
+    if (ext & ~(uint64_t)TAIRSTRING_EXT_ALL) {
+        TairStringTypeReleaseObject(o);
+        return NULL;
+    }
+
+    if (ext & TAIRSTRING_EXT_REQIDS) {
+        uint64_t j, n = RedisModule_LoadUnsigned(rdb);
+        for (j = 0; j < n; j++) {
+            RedisModuleString *id = RedisModule_LoadString(rdb);
+            long long value = RedisModule_LoadSigned(rdb);
+            uint64_t version = RedisModule_LoadUnsigned(rdb);
+            long long expire_at = RedisModule_LoadSigned(rdb);
+            long long size = RedisModule_LoadSigned(rdb);
+            uint64_t segments = RedisModule_LoadUnsigned(rdb);
+            if (segments > TAIRSTRING_RESERVE_MAX_SEGMENTS) {
+                RedisModule_FreeString(NULL, id);
+                TairStringTypeReleaseObject(o);
+                return NULL;
+            }
+            addReqId(o, id, value, version, expire_at, size, (uint32_t)segments);
+            RedisModule_FreeString(NULL, id);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_LOCK) {
+        tairStringObjExt(o)->lock_deadline = RedisModule_LoadSigned(rdb);
+    }
+
+    if (ext & TAIRSTRING_EXT_SEM) {
+        uint64_t j, n = RedisModule_LoadUnsigned(rdb);
+        tairStringObjExt(o)->semaphore = 1;
+        for (j = 0; j < n; j++) {
+            RedisModuleString *id = RedisModule_LoadString(rdb);
+            addHolder(o, id, RedisModule_LoadSigned(rdb));
+            RedisModule_FreeString(NULL, id);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_WINDOW) {
+        long long bucket_ms = RedisModule_LoadSigned(rdb);
+        uint64_t j, nbuckets = RedisModule_LoadUnsigned(rdb);
+        if (bucket_ms <= 0 || nbuckets == 0 || nbuckets > TAIRSTRING_WINDOW_MAX_BUCKETS) {
+            TairStringTypeReleaseObject(o);
+            return NULL;
+        }
+        TairStringWindow *w = createWindow(o, bucket_ms, (uint32_t)nbuckets);
+        w->head = RedisModule_LoadSigned(rdb);
+        for (j = 0; j < nbuckets; j++) {
+            w->counts[j] = RedisModule_LoadSigned(rdb);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_DECAY) {
+        long long halflife = RedisModule_LoadSigned(rdb);
+        setDecay(o, halflife, RedisModule_LoadSigned(rdb));
+    }
+
+    if (ext & TAIRSTRING_EXT_LEASE) {
+        tairStringObjExt(o)->lease_token = RedisModule_LoadUnsigned(rdb);
+        if (o->ext->lease_token >= TairStringLeaseNext) TairStringLeaseNext = o->ext->lease_token + 1;
+    }
+
+    if (ext & TAIRSTRING_EXT_SOFTTTL) {
+        setSoftTTL(o, RedisModule_LoadSigned(rdb));
+    }
+
+    if (ext & TAIRSTRING_EXT_RECOMPUTE) {
+        setRecompute(o, RedisModule_LoadSigned(rdb));
+    }
+
+    if (ext & TAIRSTRING_EXT_NS) {
+        setNamespace(o, RedisModule_LoadSigned(rdb));
+    }
+
+    if (ext & TAIRSTRING_EXT_TAGS) {
+        uint64_t j, ntags = RedisModule_LoadUnsigned(rdb);
+        int dbid = (int)RedisModule_LoadSigned(rdb);
+        RedisModuleString *keyname = RedisModule_LoadString(rdb);
+        RedisModuleString **tags = RedisModule_Alloc(sizeof(RedisModuleString *) * ntags);
+        for (j = 0; j < ntags; j++) {
+            tags[j] = RedisModule_LoadString(rdb);
+        }
+        /* The saved name may still belong to the dumped key, when RESTORE
+         * creates a copy under another name. Such a key is only indexed by
+         * the "restore" event, under its actual name. */
+        pthread_mutex_lock(&TairStringTagLock);
+        int taken = tagIndexHasKey(dbid, keyname, tags, (uint32_t)ntags);
+        pthread_mutex_unlock(&TairStringTagLock);
+        setTags(o, dbid, taken ? NULL : keyname, tags, (uint32_t)ntags);
+        for (j = 0; j < ntags; j++) {
+            RedisModule_FreeString(NULL, tags[j]);
+        }
+        RedisModule_Free(tags);
+        RedisModule_FreeString(NULL, keyname);
+    }
+
+    if (ext & TAIRSTRING_EXT_HISTORY) {
+        uint64_t keep_versions = RedisModule_LoadUnsigned(rdb);
+        long long keep_for = RedisModule_LoadSigned(rdb);
+        uint64_t j, n = RedisModule_LoadUnsigned(rdb);
+        if (keep_versions > TAIRSTRING_HISTORY_MAX || n > TAIRSTRING_HISTORY_MAX || keep_for < 0
+            || (keep_versions == 0 && keep_for == 0)) {
+            TairStringTypeReleaseObject(o);
+            return NULL;
+        }
+        setHistory(o, (uint32_t)keep_versions, keep_for);
+        for (j = 0; j < n; j++) {
+            uint64_t version = RedisModule_LoadUnsigned(rdb);
+            uint32_t flags = (uint32_t)RedisModule_LoadUnsigned(rdb);
+            long long replaced_at = RedisModule_LoadSigned(rdb);
+            historyAppend(o, version, flags, replaced_at, RedisModule_LoadString(rdb));
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_VECTOR) {
+        uint64_t j, type = RedisModule_LoadUnsigned(rdb), len = RedisModule_LoadUnsigned(rdb);
+        if (type > TAIRSTRING_VECTOR_FLOAT || len > TAIRSTRING_VECTOR_MAX_LEN) {
+            TairStringTypeReleaseObject(o);
+            return NULL;
+        }
+        TairStringVector *v = createVector(o, (int)type);
+        resizeVector(v, (uint32_t)len);
+        for (j = 0; j < len; j++) {
+            if (type == TAIRSTRING_VECTOR_INT32) {
+                ((int32_t *)v->data)[j] = (int32_t)RedisModule_LoadSigned(rdb);
+            } else if (type == TAIRSTRING_VECTOR_INT64) {
+                ((int64_t *)v->data)[j] = RedisModule_LoadSigned(rdb);
+            } else {
+                ((float *)v->data)[j] = RedisModule_LoadFloat(rdb);
+            }
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_RATELIMIT) {
+        tairStringObjExt(o)->ratelimiter = 1;
+    }
     return o;
 }
 
@@ -1290,12 +5928,225 @@ void TairStringTypeRdbSave(RedisModuleIO *rdb, void *value) {
     RedisModule_SaveUnsigned(rdb, o->version);
     RedisModule_SaveUnsigned(rdb, o->flags);
     RedisModule_SaveString(rdb, o->value);
+
+    uint64_t ext = 0;
+    if (o->ext && o->ext->nreqids) ext |= TAIRSTRING_EXT_REQIDS;
+    if (o->ext && o->ext->lock_deadline) ext |= TAIRSTRING_EXT_LOCK;
+    if (o->ext && o->ext->semaphore) ext |= TAIRSTRING_EXT_SEM;
+    if (o->ext && o->ext->window) ext |= TAIRSTRING_EXT_WINDOW;
+    if (decayActive(o)) ext |= TAIRSTRING_EXT_DECAY;
+    if (o->ext && o->ext->vector) ext |= TAIRSTRING_EXT_VECTOR;
+    if (isLeasePlaceholder(o)) ext |= TAIRSTRING_EXT_LEASE;
+    if (softTTLActive(o)) ext |= TAIRSTRING_EXT_SOFTTTL;
+    if (recomputeActive(o)) ext |= TAIRSTRING_EXT_RECOMPUTE;
+    if (nsActive(o)) ext |= TAIRSTRING_EXT_NS;
+    if (o->ext && o->ext->ntags) ext |= TAIRSTRING_EXT_TAGS;
+    if (historyActive(o)) ext |= TAIRSTRING_EXT_HISTORY;
+    if (o->ext && o->ext->ratelimiter) ext |= TAIRSTRING_EXT_RATELIMIT;
+    RedisModule_SaveUnsigned(rdb, ext);
+
+    if (ext & TAIRSTRING_EXT_REQIDS) {
+        uint32_t j;
+        RedisModule_SaveUnsigned(rdb, o->ext->nreqids);
+        for (j = 0; j < o->ext->nreqids; j++) {
+            const TairStringReqId *r = &o->ext->reqids[j];
+            RedisModule_SaveString(rdb, r->id);
+            RedisModule_SaveSigned(rdb, r->value);
+            RedisModule_SaveUnsigned(rdb, r->version);
+            RedisModule_SaveSigned(rdb, r->expire_at);
+            RedisModule_SaveSigned(rdb, r->size);
+            RedisModule_SaveUnsigned(rdb, r->segments);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_LOCK) {
+        RedisModule_SaveSigned(rdb, o->ext->lock_deadline);
+    }
+
+    if (ext & TAIRSTRING_EXT_SEM) {
+        uint32_t j;
+        RedisModule_SaveUnsigned(rdb, o->ext->nholders);
+        for (j = 0; j < o->ext->nholders; j++) {
+            RedisModule_SaveString(rdb, o->ext->holders[j].id);
+            RedisModule_SaveSigned(rdb, o->ext->holders[j].expire_at);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_WINDOW) {
+        const TairStringWindow *w = o->ext->window;
+        uint32_t j;
+        RedisModule_SaveSigned(rdb, w->bucket_ms);
+        RedisModule_SaveUnsigned(rdb, w->nbuckets);
+        RedisModule_SaveSigned(rdb, w->head);
+        for (j = 0; j < w->nbuckets; j++) {
+            RedisModule_SaveSigned(rdb, w->counts[j]);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_DECAY) {
+        RedisModule_SaveSigned(rdb, o->ext->decay_halflife);
+        RedisModule_SaveSigned(rdb, o->ext->decay_ts);
+    }
+
+    if (ext & TAIRSTRING_EXT_LEASE) {
+        RedisModule_SaveUnsigned(rdb, o->ext->lease_token);
+    }
+
+    if (ext & TAIRSTRING_EXT_SOFTTTL) {
+        RedisModule_SaveSigned(rdb, o->ext->soft_expire_at);
+    }
+
+    if (ext & TAIRSTRING_EXT_RECOMPUTE) {
+        RedisModule_SaveSigned(rdb, o->ext->recompute_ms);
+    }
+
+    if (ext & TAIRSTRING_EXT_NS) {
+        RedisModule_SaveSigned(rdb, o->ext->ns_generation);
+    }
+
+    if (ext & TAIRSTRING_EXT_TAGS) {
+        uint32_t j;
+        RedisModule_SaveUnsigned(rdb, o->ext->ntags);
+        RedisModule_SaveSigned(rdb, o->ext->tag_dbid);
+        RedisModule_SaveString(rdb, o->ext->tag_key);
+        for (j = 0; j < o->ext->ntags; j++) {
+            RedisModule_SaveString(rdb, o->ext->tags[j]);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_HISTORY) {
+        uint32_t j;
+        RedisModule_SaveUnsigned(rdb, o->ext->keep_versions);
+        RedisModule_SaveSigned(rdb, o->ext->keep_for);
+        RedisModule_SaveUnsigned(rdb, o->ext->nhistory);
+        for (j = 0; j < o->ext->nhistory; j++) {
+            const TairStringVersion *v = &o->ext->history[j];
+            RedisModule_SaveUnsigned(rdb, v->version);
+            RedisModule_SaveUnsigned(rdb, v->flags);
+            RedisModule_SaveSigned(rdb, v->replaced_at);
+            RedisModule_SaveString(rdb, v->value);
+        }
+    }
+
+    if (ext & TAIRSTRING_EXT_VECTOR) {
+        const TairStringVector *v = o->ext->vector;
+        uint32_t j;
+        RedisModule_SaveUnsigned(rdb, v->type);
+        RedisModule_SaveUnsigned(rdb, v->len);
+        for (j = 0; j < v->len; j++) {
+            if (v->type == TAIRSTRING_VECTOR_INT32) {
+                RedisModule_SaveSigned(rdb, ((int32_t *)v->data)[j]);
+            } else if (v->type == TAIRSTRING_VECTOR_INT64) {
+                RedisModule_SaveSigned(rdb, ((int64_t *)v->data)[j]);
+            } else {
+                RedisModule_SaveFloat(rdb, ((float *)v->data)[j]);
+            }
+        }
+    }
 }
 
 void TairStringTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
     const struct TairStringObj *o = value;
     assert(value != NULL);
     RedisModule_EmitAOF(aof, "EXSET", "ssclcl", key, o->value, "ABS", o->version, "FLAGS", (long long)o->flags);
+
+    if (o->ext) {
+        uint32_t j;
+        for (j = 0; j < o->ext->nreqids; j++) {
+            const TairStringReqId *r = &o->ext->reqids[j];
+            RedisModule_EmitAOF(aof, "EXREQIDSET", "sslllll", key, r->id, r->value, (long long)r->version,
+                                r->expire_at, r->size, (long long)r->segments);
+        }
+        if (o->ext->lock_deadline) {
+            RedisModule_EmitAOF(aof, "EXLOCKSET", "ssll", key, o->value, (long long)o->version,
+                                o->ext->lock_deadline);
+        }
+        if (o->ext->semaphore) {
+            uint32_t n = 2 + 2 * o->ext->nholders;
+            RedisModuleString **args = RedisModule_Alloc(sizeof(RedisModuleString *) * n);
+            args[0] = key;
+            args[1] = RedisModule_CreateStringFromLongLong(NULL, (long long)o->version);
+            for (j = 0; j < o->ext->nholders; j++) {
+                args[2 + 2 * j] = o->ext->holders[j].id;
+                args[3 + 2 * j] = RedisModule_CreateStringFromLongLong(NULL, o->ext->holders[j].expire_at);
+            }
+            RedisModule_EmitAOF(aof, "EXSEMSET", "v", args, (size_t)n);
+            for (j = 1; j < n; j += 2) {
+                RedisModule_FreeString(NULL, args[j]);
+            }
+            RedisModule_Free(args);
+        }
+        if (o->ext->ratelimiter) {
+            RedisModule_EmitAOF(aof, "EXRATESET", "s", key);
+        }
+        if (o->ext->window) {
+            /* Oldest first, the newest bucket always being emitted so that
+             * the window exists even if all its buckets are 0. */
+            const TairStringWindow *w = o->ext->window;
+            long long e = w->head - w->nbuckets + 1;
+            for (e = e < 0 ? 0 : e; e <= w->head; e++) {
+                long long count = w->counts[e % w->nbuckets];
+                if (count == 0 && e != w->head) continue;
+                RedisModule_EmitAOF(aof, "EXWBUCKETSET", "slllll", key, (long long)o->version, w->bucket_ms,
+                                    (long long)w->nbuckets, e, count);
+            }
+        }
+        if (decayActive(o)) {
+            RedisModule_EmitAOF(aof, "EXDECAYSET", "sll", key, o->ext->decay_halflife, o->ext->decay_ts);
+        }
+        if (isLeasePlaceholder(o)) {
+            /* The expire of the key follows. */
+            RedisModule_EmitAOF(aof, "EXLEASESET", "sll", key, (long long)o->ext->lease_token, 0LL);
+        }
+        if (softTTLActive(o)) {
+            RedisModule_EmitAOF(aof, "EXSOFTSET", "sl", key, o->ext->soft_expire_at);
+        }
+        if (recomputeActive(o)) {
+            RedisModule_EmitAOF(aof, "EXRECOMPUTESET", "sl", key, o->ext->recompute_ms);
+        }
+        if (nsActive(o)) {
+            RedisModule_EmitAOF(aof, "EXNSSET", "sl", key, o->ext->ns_generation);
+        }
+        if (o->ext->ntags) {
+            RedisModule_EmitAOF(aof, "EXTAGSET", "sv", key, o->ext->tags, (size_t)o->ext->ntags);
+        }
+        if (historyActive(o)) {
+            uint32_t n = 3 + 4 * o->ext->nhistory;
+            RedisModuleString **args = RedisModule_Alloc(sizeof(RedisModuleString *) * n);
+            args[0] = key;
+            args[1] = RedisModule_CreateStringFromLongLong(NULL, o->ext->keep_versions);
+            args[2] = RedisModule_CreateStringFromLongLong(NULL, o->ext->keep_for);
+            for (j = 0; j < o->ext->nhistory; j++) {
+                const TairStringVersion *v = &o->ext->history[j];
+                args[3 + 4 * j] = RedisModule_CreateStringFromLongLong(NULL, (long long)v->version);
+                args[4 + 4 * j] = RedisModule_CreateStringFromLongLong(NULL, v->flags);
+                args[5 + 4 * j] = RedisModule_CreateStringFromLongLong(NULL, v->replaced_at);
+                args[6 + 4 * j] = v->value;
+            }
+            RedisModule_EmitAOF(aof, "EXHISTSET", "v", args, (size_t)n);
+            for (j = 1; j < n; j++) {
+                if (j < 3 || (j - 3) % 4 != 3) RedisModule_FreeString(NULL, args[j]);
+            }
+            RedisModule_Free(args);
+        }
+        if (o->ext->vector) {
+            /* Only the elements that are not 0 need to be set. */
+            TairStringVector *v = o->ext->vector;
+            size_t size = vectorElemSize(v->type), argc;
+            uint32_t n = 0, *idxs = RedisModule_Alloc(sizeof(uint32_t) * (v->len + 1));
+            static const char zero[8] = {0};
+            for (j = 0; j < v->len; j++) {
+                if (memcmp((char *)v->data + size * j, zero, size)) idxs[n++] = j;
+            }
+            RedisModuleString **args = vectorSetArgs(NULL, key, (TairStringObj *)o, idxs, n, &argc);
+            RedisModule_EmitAOF(aof, "EXVSET", "v", args, argc);
+            for (j = 1; j < argc; j++) {
+                RedisModule_FreeString(NULL, args[j]);
+            }
+            RedisModule_Free(args);
+            RedisModule_Free(idxs);
+        }
+    }
 }
 
 size_t TairStringTypeMemUsage(const void *value) {
@@ -1303,10 +6154,44 @@ size_t TairStringTypeMemUsage(const void *value) {
     assert(value != NULL);
     size_t len;
     RedisModule_StringPtrLen(o->value, &len);
-    return sizeof(*o) + len;
+    size_t size = sizeof(*o) + len;
+
+    if (o->ext) {
+        uint32_t j;
+        size += sizeof(*o->ext) + sizeof(TairStringReqId) * o->ext->nreqids;
+        for (j = 0; j < o->ext->nreqids; j++) {
+            RedisModule_StringPtrLen(o->ext->reqids[j].id, &len);
+            size += len;
+        }
+        size += sizeof(TairStringHolder) * o->ext->nholders;
+        for (j = 0; j < o->ext->nholders; j++) {
+            RedisModule_StringPtrLen(o->ext->holders[j].id, &len);
+            size += len;
+        }
+        if (o->ext->window) {
+            size += sizeof(*o->ext->window) + sizeof(long long) * o->ext->window->nbuckets;
+        }
+        if (o->ext->vector) {
+            size += sizeof(*o->ext->vector) + vectorElemSize(o->ext->vector->type) * o->ext->vector->len;
+        }
+        size += sizeof(RedisModuleString *) * o->ext->ntags;
+        for (j = 0; j < o->ext->ntags; j++) {
+            RedisModule_StringPtrLen(o->ext->tags[j], &len);
+            size += len;
+        }
+        size += sizeof(TairStringVersion) * o->ext->nhistory;
+        for (j = 0; j < o->ext->nhistory; j++) {
+            RedisModule_StringPtrLen(o->ext->history[j].value, &len);
+            size += len;
+        }
+    }
+    return size;
 }
 
-void TairStringTypeFree(void *value) { TairStringTypeReleaseObject(value); }
+void TairStringTypeFree(void *value) {
+    tagIndexRemove(value);
+    TairStringTypeReleaseObject(value);
+}
 
 void TairStringTypeDigest(RedisModuleDigest *md, void *value) {
     const struct TairStringObj *o = value;
@@ -1320,41 +6205,81 @@ void TairStringTypeDigest(RedisModuleDigest *md, void *value) {
 }
 
 int Module_CreateCommands(RedisModuleCtx *ctx) {
-#define CREATE_CMD(name, tgt, attr)                                                       \
-    do {                                                                                  \
-        if (RedisModule_CreateCommand(ctx, name, tgt, attr, 1, 1, 1) != REDISMODULE_OK) { \
-            return REDISMODULE_ERR;                                                       \
-        }                                                                                 \
+#define CREATE_CMD_KEYS(name, tgt, attr, firstkey, lastkey, keystep)                                      \
+    do {                                                                                                  \
+        if (RedisModule_CreateCommand(ctx, name, tgt, attr, firstkey, lastkey, keystep) != REDISMODULE_OK) { \
+            return REDISMODULE_ERR;                                                                       \
+        }                                                                                                 \
     } while (0);
 
+#define CREATE_CMD(name, tgt, attr) CREATE_CMD_KEYS(name, tgt, attr, 1, 1, 1)
 #define CREATE_WRCMD(name, tgt) CREATE_CMD(name, tgt, "write deny-oom")
 #define CREATE_ROCMD(name, tgt) CREATE_CMD(name, tgt, "readonly fast")
 
-    CREATE_WRCMD("exset", TairStringTypeSet_RedisCommand)
-    CREATE_ROCMD("exget", TairStringTypeGet_RedisCommand)
+    /* The NS key is declared through the getkeys-api. */
+    CREATE_CMD("exset", TairStringTypeSet_RedisCommand, "write deny-oom getkeys-api")
+    CREATE_CMD("exget", TairStringTypeGet_RedisCommand, "readonly fast getkeys-api")
+    CREATE_CMD("exlease", TairStringTypeExLease_RedisCommand, "write deny-oom getkeys-api")
+    CREATE_CMD_KEYS("exgetifnewer", TairStringTypeGetIfNewer_RedisCommand, "readonly", 1, -1, 2)
+    CREATE_CMD_KEYS("exgetminversion", TairStringTypeGetMinVersion_RedisCommand, "readonly", 1, -1, 2)
+    CREATE_CMD_KEYS("exmeta", TairStringTypeMeta_RedisCommand, "readonly", 1, -1, 1)
     CREATE_WRCMD("exincrby", TairStringTypeIncrBy_RedisCommand)
     CREATE_WRCMD("exincrbyfloat", TairStringTypeIncrByFloat_RedisCommand)
     CREATE_WRCMD("exsetver", TairStringTypeExSetVer_RedisCommand)
+    CREATE_CMD("exreqidset", TairStringTypeExReqIdSet_RedisCommand, "write")
+    CREATE_CMD("exdecayset", TairStringTypeExDecaySet_RedisCommand, "write")
+    CREATE_CMD("exleaseset", TairStringTypeExLeaseSet_RedisCommand, "write")
+    CREATE_CMD("exsoftset", TairStringTypeExSoftSet_RedisCommand, "write")
+    CREATE_CMD("exrecomputeset", TairStringTypeExRecomputeSet_RedisCommand, "write")
+    CREATE_CMD("exnsset", TairStringTypeExNsSet_RedisCommand, "write")
+    CREATE_CMD("extagset", TairStringTypeExTagSet_RedisCommand, "write")
+    CREATE_CMD_KEYS("exinvalidate", TairStringTypeExInvalidate_RedisCommand, "write", 0, 0, 0)
+    CREATE_CMD_KEYS("exscan", TairStringTypeExScan_RedisCommand, "readonly", 0, 0, 0)
+    CREATE_CMD("exhistset", TairStringTypeExHistSet_RedisCommand, "write")
+    CREATE_CMD_KEYS("exsetvergt", TairStringTypeExSetVerGt_RedisCommand, "write deny-oom", 1, -1, 3)
     CREATE_WRCMD("excas", TairStringTypeExCas_RedisCommand)
     CREATE_WRCMD("excad", TairStringTypeExCad_RedisCommand)
     CREATE_WRCMD("exprepend", TairStringTypeExPrepend_RedisCommand)
     CREATE_WRCMD("exappend", TairStringTypeExAppend_RedisCommand)
     CREATE_WRCMD("exgae", TairStringTypeExGAE_RedisCommand)
+    CREATE_WRCMD("exapply", TairStringTypeExApply_RedisCommand)
+    CREATE_WRCMD("exlock", TairStringTypeExLock_RedisCommand)
+    CREATE_WRCMD("exrenew", TairStringTypeExRenew_RedisCommand)
+    CREATE_WRCMD("exunlock", TairStringTypeExUnlock_RedisCommand)
+    CREATE_CMD("exlockset", TairStringTypeExLockSet_RedisCommand, "write")
+    CREATE_WRCMD("exsemacquire", TairStringTypeExSemAcquire_RedisCommand)
+    CREATE_WRCMD("exsemrelease", TairStringTypeExSemRelease_RedisCommand)
+    CREATE_CMD("exsemset", TairStringTypeExSemSet_RedisCommand, "write")
+    CREATE_WRCMD("exratelimit", TairStringTypeExRateLimit_RedisCommand)
+    CREATE_CMD("exrateset", TairStringTypeExRateSet_RedisCommand, "write")
+    CREATE_WRCMD("exwincrby", TairStringTypeExWIncrBy_RedisCommand)
+    CREATE_ROCMD("exwcount", TairStringTypeExWCount_RedisCommand)
+    CREATE_CMD("exwbucketset", TairStringTypeExWBucketSet_RedisCommand, "write")
+    CREATE_WRCMD("exvincrby", TairStringTypeExVIncrBy_RedisCommand)
+    CREATE_WRCMD("exvadd", TairStringTypeExVAdd_RedisCommand)
+    CREATE_ROCMD("exvget", TairStringTypeExVGet_RedisCommand)
+    CREATE_CMD("exvset", TairStringTypeExVSet_RedisCommand, "write")
+    CREATE_CMD("exwait", TairStringTypeExWait_RedisCommand, "readonly")
+    CREATE_CMD_KEYS("exchanges", TairStringTypeExChanges_RedisCommand, "readonly", 0, 0, 0)
     /* CAS/CAD cmds for redis string type. */
     CREATE_WRCMD("cas", StringTypeCas_RedisCommand)
     CREATE_WRCMD("cad", StringTypeCad_RedisCommand)
+    CREATE_WRCMD("casdigest", StringTypeCasDigest_RedisCommand)
+    CREATE_WRCMD("caddigest", StringTypeCadDigest_RedisCommand)
 
     return REDISMODULE_OK;
 }
 
 int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    REDISMODULE_NOT_USED(argv);
-    REDISMODULE_NOT_USED(argc);
-
     if (RedisModule_Init(ctx, "exstrtype", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
     }
 
+    if (parseModuleArgs(ctx, argv, argc) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    resolvePublishApi();
+
     RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION,
                                  .rdb_load = TairStringTypeRdbLoad,
                                  .rdb_save = TairStringTypeRdbSave,
@@ -1363,7 +6288,7 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
                                  .free = TairStringTypeFree,
                                  .digest = TairStringTypeDigest};
 
-    TairStringType = RedisModule_CreateDataType(ctx, "exstrtype", TAIRSTRING_ENCVER_VER_1, &tm);
+    TairStringType = RedisModule_CreateDataType(ctx, "exstrtype", TAIRSTRING_ENCVER_VER_2, &tm);
     if (TairStringType == NULL) {
         return REDISMODULE_ERR;
     }
@@ -1372,5 +6297,17 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         return REDISMODULE_ERR;
     }
 
+    TairStringLeaseNext = ((uint64_t)RedisModule_Milliseconds() << 16) + 1;
+    TairStringTagIndex = RedisModule_CreateDict(NULL);
+    TairStringWaitersByKey = RedisModule_CreateDict(NULL);
+    TairStringWaitersByClient = RedisModule_CreateDict(NULL);
+    if (RedisModule_SubscribeToKeyspaceEvents(ctx,
+                                              REDISMODULE_NOTIFY_GENERIC | REDISMODULE_NOTIFY_STRING
+                                                  | REDISMODULE_NOTIFY_EXPIRED | REDISMODULE_NOTIFY_EVICTED,
+                                              waitKeyspaceCallback) != REDISMODULE_OK) {
+        return REDISMODULE_ERR;
+    }
+    subscribeToServerEvents(ctx);
+
     return REDISMODULE_OK;
 }
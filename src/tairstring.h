@@ -17,6 +17,13 @@
 #pragma once
 
 #define TAIRSTRING_STATUSMSG_VERSION "CAS_FAILED"
+#define TAIRSTRING_STATUSMSG_NOT_MODIFIED "NOT_MODIFIED"
+#define TAIRSTRING_STATUSMSG_TIMEOUT "TIMEOUT"
+#define TAIRSTRING_STATUSMSG_RESYNC "RESYNC"
+#define TAIRSTRING_STATUSMSG_STALE "STALE"
+#define TAIRSTRING_STATUSMSG_ABORTED "ABORTED"
+#define TAIRSTRING_STATUSMSG_SKIPPED "SKIPPED"
+#define TAIRSTRING_STATUSMSG_REFRESH "REFRESH"
 #define TAIRSTRING_ERRORMSG_SYNTAX "ERR syntax error"
 #define TAIRSTRING_ERRORMSG_VERSION "ERR update version is stale"
 #define TAIRSTRING_ERRORMSG_NO_INT "ERR value is not an integer"
@@ -24,5 +31,28 @@
 #define TAIRSTRING_ERRORMSG_OVERFLOW "ERR increment or decrement would overflow"
 #define TAIRSTRING_ERRORMSG_MIN_MAX "ERR min or max is specified, but not valid"
 #define TAIRSTRING_ERRORMSG_VER_INT "ERR version should be integer"
+#define TAIRSTRING_ERRORMSG_DIGEST "ERR digest should be 16 hex digits"
 #define TAIRSTRING_ERRORMSG_EINVAL "ERR command non existing or wrong arity or wrong format specifier"
 #define TAIRSTRING_ERRORMSG_APPENDBUFFER "ERR append buffer failed"
+#define TAIRSTRING_ERRORMSG_PROGRAM "ERR invalid program"
+#define TAIRSTRING_ERRORMSG_DIV_ZERO "ERR division by zero"
+#define TAIRSTRING_ERRORMSG_OFFSET "ERR offset is out of range"
+#define TAIRSTRING_ERRORMSG_TOO_LARGE "ERR string exceeds maximum allowed size"
+#define TAIRSTRING_ERRORMSG_RESERVE "ERR reserve needs a positive num and 1 to 16 segments"
+#define TAIRSTRING_ERRORMSG_REQID "ERR request id was already used with another num or RESERVE"
+#define TAIRSTRING_ERRORMSG_SEM_LIMIT "ERR limit should be between 1 and 1024"
+#define TAIRSTRING_ERRORMSG_RATELIMIT "ERR rate should be between 1 and 1000000 and burst between 1 and 1000000000"
+#define TAIRSTRING_ERRORMSG_WINDOW "ERR window should be a multiple of bucket and have at most 4096 buckets"
+#define TAIRSTRING_ERRORMSG_WINDOW_MISMATCH "ERR window or bucket does not match the existing counter"
+#define TAIRSTRING_ERRORMSG_NOT_WINDOW "ERR key is not a windowed counter"
+#define TAIRSTRING_ERRORMSG_NOT_LOCK "ERR key is not a lock"
+#define TAIRSTRING_ERRORMSG_NOT_SEMAPHORE "ERR key is not a semaphore"
+#define TAIRSTRING_ERRORMSG_NOT_RATELIMIT "ERR key is not a rate limiter"
+#define TAIRSTRING_ERRORMSG_NOT_VECTOR "ERR key is not a vector"
+#define TAIRSTRING_ERRORMSG_VECTOR_TYPE "ERR type should be int32, int64 or float and match the existing vector"
+#define TAIRSTRING_ERRORMSG_VECTOR_INDEX "ERR index is out of range, a vector holds at most 65536 elements"
+#define TAIRSTRING_ERRORMSG_LEASE_REPLICA "ERR EXLEASE is only allowed on the master"
+#define TAIRSTRING_ERRORMSG_NS "ERR namespace key is not an integer"
+#define TAIRSTRING_ERRORMSG_HISTORY "ERR keepversions should be between 0 and 64 and keepfor not negative"
+#define TAIRSTRING_ERRORMSG_INTERNAL "ERR this command is only replicated or loaded from the AOF"
+#define TAIRSTRING_ERRORMSG_CHANGELOG_DISABLED "ERR change log is disabled, load the module with changelog-size"
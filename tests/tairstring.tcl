@@ -767,10 +767,10 @@ start_server {tags {"ex_string"} overrides {bind 0.0.0.0}} {
         assert_match {*ERR*syntax*error*} $err
 
         catch {r exget exstringkey WITHFLAGS MIN 10} err
-        assert_match {*ERR*wrong*number*of*arguments*} $err
+        assert_match {*ERR*syntax*error*} $err
 
         catch {r exget exstringkey PX 2000} err
-        assert_match {*ERR*wrong*number*of*arguments*} $err
+        assert_match {*ERR*syntax*error*} $err
 
         catch {r exget exstringkey NX} err
         assert_match {*ERR*syntax*error*} $err
@@ -1105,8 +1105,1283 @@ start_server {tags {"ex_string"} overrides {bind 0.0.0.0}} {
         assert_equal "OK" [r restore exstringkey 0 $dump]
         assert_equal {bar 1} [r exget exstringkey]
     }
+
+    test {exget ifnewer} {
+        r del exstringkey exstringkey2
+
+        catch {r exget exstringkey IFNEWER} err
+        assert_match {*ERR*syntax*error*} $err
+
+        catch {r exget exstringkey IFNEWER abc} err
+        assert_match {*ERR*version*should*be*integer*} $err
+
+        set res [r exget exstringkey IFNEWER 1]
+        assert_equal $res ""
+
+        r exset exstringkey bar FLAGS 10
+        r exset exstringkey bar1
+
+        set res [r exget exstringkey IFNEWER 2]
+        assert_equal $res "NOT_MODIFIED"
+
+        set res [r exget exstringkey IFNEWER 1]
+        assert_equal $res "bar1 2"
+
+        set res [r exget exstringkey WITHFLAGS IFNEWER 1]
+        assert_equal $res "bar1 2 10"
+
+        set res [r exget exstringkey IFNEWER 3]
+        assert_equal $res "bar1 2"
+    }
+
+    test {exgetifnewer multi keys} {
+        r del exstringkey exstringkey2 exstringkey3
+
+        catch {r exgetifnewer exstringkey} err
+        assert_match {*ERR*wrong*number*of*arguments*} $err
+
+        catch {r exgetifnewer exstringkey 1 exstringkey2} err
+        assert_match {*ERR*wrong*number*of*arguments*} $err
+
+        catch {r exgetifnewer exstringkey 1 exstringkey2 -1} err
+        assert_match {*ERR*version*should*be*integer*} $err
+
+        r exset exstringkey foo
+        r exset exstringkey2 bar
+        r exset exstringkey2 bar1
+        r set exstringkey3 foo
+
+        set res [r exgetifnewer exstringkey 1 exstringkey2 1 not-exists 1]
+        assert_equal $res "NOT_MODIFIED {bar1 2} {}"
+
+        catch {r exgetifnewer exstringkey3 1} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {exmeta} {
+        r del exstringkey exstringkey2 exstringkey3
+
+        catch {r exmeta} err
+        assert_match {*ERR*wrong*number*of*arguments*} $err
+
+        r exset exstringkey bar FLAGS 10
+        r exset exstringkey2 foobar PX 100000
+        r exset exstringkey2 foobar2 KEEPTTL
+
+        set res [r exmeta exstringkey]
+        assert_equal $res "{1 10 -1 3}"
+
+        set res [r exmeta exstringkey2 not-exists]
+        assert_equal [llength $res] 2
+        set meta [lindex $res 0]
+        assert_equal [lindex $meta 0] 2
+        assert_equal [lindex $meta 1] 0
+        assert {[lindex $meta 2] > 0 && [lindex $meta 2] <= 100000}
+        assert_equal [lindex $meta 3] 7
+        assert_equal [lindex $res 1] ""
+
+        r set exstringkey3 foo
+        catch {r exmeta exstringkey3} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {exwait} {
+        r del exstringkey
+
+        catch {r exwait exstringkey 1} err
+        assert_match {*ERR*wrong*number*of*arguments*} $err
+
+        catch {r exwait exstringkey abc 100} err
+        assert_match {*ERR*version*should*be*integer*} $err
+
+        catch {r exwait exstringkey 1 -1} err
+        assert_match {*ERR*syntax*error*} $err
+
+        set res [r exwait exstringkey 1 100]
+        assert_equal $res ""
+
+        r exset exstringkey bar
+        set res [r exwait exstringkey 0 100]
+        assert_equal $res "bar 1"
+
+        set res [r exwait exstringkey 1 100]
+        assert_equal $res "TIMEOUT"
+
+        set rd [redis_deferring_client]
+        $rd exwait exstringkey 1 0
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exwait client not blocked"
+        }
+        r exsetver exstringkey 1
+        r exappend exstringkey foo
+        assert_equal [$rd read] "barfoo 2"
+
+        $rd exwait exstringkey 2 0
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exwait client not blocked"
+        }
+        r del exstringkey
+        assert_equal [$rd read] ""
+
+        $rd exwait exstringkey 0 0
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exwait client not blocked"
+        }
+        r exincrby exstringkey 10
+        assert_equal [$rd read] "10 1"
+
+        $rd exwait exstringkey 1 0
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exwait client not blocked"
+        }
+        r set exstringkey foo
+        assert_equal [$rd read] ""
+
+        # Flushes and SWAPDB wake the waiters up as if their keys were deleted.
+        r del exstringkey
+        r exset exstringkey bar
+        $rd exwait exstringkey 1 0
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exwait client not blocked"
+        }
+        r flushdb
+        assert_equal [$rd read] ""
+
+        r exlease exstringkey 10000
+        $rd exlease exstringkey 10000
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exlease client not blocked"
+        }
+        r swapdb 9 10
+        assert_equal [$rd read] ""
+        r swapdb 9 10
+        r del exstringkey
+        $rd close
+
+        r set exstringkey foo
+        catch {r exwait exstringkey 1 100} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {exget minversion} {
+        r del exstringkey exstringkey2
+
+        catch {r exget exstringkey MINVERSION} err
+        assert_match {*ERR*syntax*error*} $err
+
+        catch {r exget exstringkey MINVERSION -1} err
+        assert_match {*ERR*version*should*be*integer*} $err
+
+        set res [r exget exstringkey MINVERSION 0]
+        assert_equal $res ""
+
+        set res [r exget exstringkey MINVERSION 1]
+        assert_equal $res "STALE"
+
+        r exset exstringkey bar
+        r exset exstringkey bar1
+
+        set res [r exget exstringkey MINVERSION 3]
+        assert_equal $res "STALE"
+
+        set res [r exget exstringkey MINVERSION 2]
+        assert_equal $res "bar1 2"
+
+        set res [r exget exstringkey WITHFLAGS MINVERSION 1]
+        assert_equal $res "bar1 2 0"
+
+        set res [r exget exstringkey MINVERSION 1 IFNEWER 2]
+        assert_equal $res "NOT_MODIFIED"
+
+        r exset exstringkey2 foo
+        set res [r exgetminversion exstringkey 2 exstringkey2 2 not-exists 0]
+        assert_equal $res "{bar1 2} STALE {}"
+
+        catch {r exgetminversion exstringkey 2 exstringkey2} err
+        assert_match {*ERR*wrong*number*of*arguments*} $err
+    }
+
+    test {cas/cad on encoded strings} {
+        r del exstringkey
+
+        r set exstringkey 12345
+        assert_equal 0 [r cas exstringkey 1234 100]
+        assert_equal 1 [r cas exstringkey 12345 100]
+        assert_equal 100 [r get exstringkey]
+        assert_equal 0 [r cad exstringkey 10]
+        assert_equal 1 [r cad exstringkey 100]
+        assert_equal 0 [r exists exstringkey]
+
+        # A failed compare leaves short values encoded as they were.
+        r set exstringkey 100
+        assert_equal 0 [r cad exstringkey 10]
+        assert_equal int [r object encoding exstringkey]
+        r set exstringkey hello
+        assert_equal 0 [r cad exstringkey hell]
+        assert_equal 0 [r caddigest exstringkey e64609b8b0141cb4]
+        assert_equal embstr [r object encoding exstringkey]
+
+        # Longer embstr values are compared in place.
+        r set exstringkey [string repeat a 30]
+        assert_equal 0 [r cad exstringkey [string repeat b 30]]
+        assert_equal 1 [r cad exstringkey [string repeat a 30]]
+
+        set big [string repeat x 65536]
+        r set exstringkey $big
+        assert_equal 0 [r cas exstringkey "${big}y" bar]
+        assert_equal 1 [r cas exstringkey $big bar PX 100000]
+        assert_equal bar [r get exstringkey]
+        assert_equal 1 [r cas exstringkey bar baz KEEPTTL]
+        assert {[r pttl exstringkey] > 0}
+    }
+
+    test {digest cas/cad} {
+        r del exstringkey
+
+        r set exstringkey hello
+        assert_equal 0 [r casdigest exstringkey cf8f62764b210ab6 bar]
+        assert_equal 1 [r casdigest exstringkey 0F656F01EECFE400 bar]
+        assert_equal bar [r get exstringkey]
+        catch {r casdigest exstringkey 331e54cf2349671 foo} err
+        assert_match {*ERR digest*} $err
+        catch {r casdigest exstringkey 331e54cf2349671z foo} err
+        assert_match {*ERR digest*} $err
+        assert_equal 0 [r caddigest exstringkey e64609b8b0141cb4]
+        assert_equal 1 [r caddigest exstringkey 331e54cf23496717]
+        assert_equal 0 [r exists exstringkey]
+        assert_equal -1 [r caddigest exstringkey 331e54cf23496717]
+
+        r set exstringkey 12345678901
+        assert_equal 1 [r casdigest exstringkey ff35d62a84dbea6b foo PX 100000]
+        assert {[r pttl exstringkey] > 0}
+    }
+
+    test {exget withdigest and excas digest} {
+        r del exstringkey
+
+        r exset exstringkey hello
+        assert_equal {hello 1 0f656f01eecfe400} [r exget exstringkey withdigest]
+        assert_equal {hello 1 0 0f656f01eecfe400} [r exget exstringkey withflags withdigest]
+
+        assert_equal {CAS_FAILED hello 1} [r excas exstringkey world digest cf8f62764b210ab6]
+        assert_equal {OK {} 2} [r excas exstringkey world digest 0f656f01eecfe400]
+        # The cached digest must follow the new value.
+        assert_equal {world 2 cf8f62764b210ab6} [r exget exstringkey withdigest]
+
+        r exappend exstringkey s
+        r exprepend exstringkey s
+        assert_equal {CAS_FAILED sworlds 4} [r excas exstringkey foo digest cf8f62764b210ab6]
+
+        r exset exstringkey 12345678900
+        r exincrby exstringkey 1
+        assert_equal {12345678901 6 ff35d62a84dbea6b} [r exget exstringkey withdigest]
+
+        catch {r excas exstringkey foo digest xyz} err
+        assert_match {*ERR digest*} $err
+        assert_equal -1 [r excas nokey foo digest 0f656f01eecfe400]
+    }
+
+    test {exapply} {
+        r del exstringkey
+
+        # A missing key is an empty value at version 0.
+        assert_equal {10 1} [r exapply exstringkey {val len 10 add}]
+        assert_equal {15 2} [r exapply exstringkey {val $1 add} 5]
+        assert_equal {30 3} [r exapply exstringkey {val 2 mul}]
+        assert_equal {7 4} [r exapply exstringkey {val 4 div}]
+        assert_equal {1 5} [r exapply exstringkey {val 3 mod}]
+
+        # Bounded increment, abort if it would go past the limit.
+        assert_equal ABORTED [r exapply exstringkey {val $1 add dup $2 gt abortif} 10 5]
+        assert_equal {1 5} [r exget exstringkey]
+        assert_equal {4 6} [r exapply exstringkey {val $1 add dup $2 gt abortif} 3 5]
+
+        # Byte splicing.
+        r exset exstringkey hello
+        assert_equal {hello world 8} [r exapply exstringkey {val $1 cat} " world"]
+        assert_equal {world 9} [r exapply exstringkey {val 6 -1 substr}]
+        assert_equal {wOrld 10} [r exapply exstringkey {val 1 $1 setrange} O]
+        assert_equal ABORTED [r exapply exstringkey {val $1 seq not abortif $2} world ok]
+        assert_equal {ok 11} [r exapply exstringkey {val $1 seq not abortif $2} wOrld ok]
+        assert_equal [list "ok\x00\x00x" 12] [r exapply exstringkey {val 4 $1 setrange} x]
+
+        # Version is available to the program.
+        assert_equal {12 13} [r exapply exstringkey {ver}]
+
+        # Programs are checked before touching the key.
+        catch {r exapply exstringkey {add}} err
+        assert_match {*ERR invalid program*} $err
+        catch {r exapply exstringkey {val nosuchop}} err
+        assert_match {*ERR invalid program*} $err
+        catch {r exapply exstringkey {$2} a} err
+        assert_match {*ERR invalid program*} $err
+        catch {r exapply exstringkey {val pop}} err
+        assert_match {*ERR invalid program*} $err
+        catch {r exapply exstringkey [string repeat "val pop " 100]val} err
+        assert_match {*ERR invalid program*} $err
+
+        # Runtime errors do not write anything.
+        catch {r exapply exstringkey {val 0 div}} err
+        assert_match {*ERR division by zero*} $err
+        catch {r exapply exstringkey {abc 1 add}} err
+        assert_match {*ERR invalid program*} $err
+        catch {r exapply exstringkey {$1 1 add} abc} err
+        assert_match {*ERR value is not an integer*} $err
+        catch {r exapply exstringkey {9223372036854775807 1 add}} err
+        assert_match {*ERR increment or decrement would overflow*} $err
+        assert_equal {12 13} [r exget exstringkey]
+
+        r set exstringkey bar
+        catch {r exapply exstringkey {val}} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {vergt} {
+        r del exstringkey
+
+        assert_equal SKIPPED [r exset exstringkey foo VERGT 0]
+        assert_equal OK [r exset exstringkey foo VERGT 10]
+        assert_equal {foo 10} [r exget exstringkey]
+        assert_equal SKIPPED [r exset exstringkey bar VERGT 10]
+        assert_equal SKIPPED [r exset exstringkey bar VERGT 9]
+        assert_equal {foo 10} [r exget exstringkey]
+        assert_equal 12 [r exset exstringkey bar VERGT 12 WITHVERSION]
+
+        r exset exstringkey 1 ABS 20
+        assert_equal SKIPPED [r exincrby exstringkey 1 VERGT 20]
+        assert_equal 2 [r exincrby exstringkey 1 VERGT 21]
+        assert_equal {2 21} [r exget exstringkey]
+        assert_equal SKIPPED [r exincrbyfloat exstringkey 1.5 VERGT 21]
+        assert_equal 3.5 [r exincrbyfloat exstringkey 1.5 VERGT 22]
+
+        r exset exstringkey foo ABS 30
+        assert_equal SKIPPED [r exappend exstringkey bar VERGT 29]
+        assert_equal 31 [r exappend exstringkey bar VERGT 31]
+        assert_equal SKIPPED [r exprepend exstringkey bar VERGT 31]
+        assert_equal 40 [r exprepend exstringkey bar VERGT 40]
+        assert_equal {barfoobar 40} [r exget exstringkey]
+
+        catch {r exset exstringkey foo VER 1 VERGT 2} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey foo ABS 1 VERGT 2} err
+        assert_match {*ERR syntax error*} $err
+
+        r set exstringkey bar
+        catch {r exset exstringkey foo VERGT 100} err
+        assert_match {*WRONGTYPE*} $err
+        catch {r exappend exstringkey foo VERGT 100} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {exsetvergt} {
+        r del exstringkey exstringkey2 exstringkey3
+
+        r exset exstringkey foo ABS 10 EX 100
+        r set exstringkey3 bar
+        set res [r exsetvergt exstringkey bar 11 exstringkey2 baz 5 exstringkey3 foo 1]
+        assert_equal 11 [lindex $res 0]
+        assert_equal 5 [lindex $res 1]
+        assert_match {*WRONGTYPE*} [lindex $res 2]
+        assert_equal {bar 11} [r exget exstringkey]
+        assert_equal -1 [r ttl exstringkey]
+        assert_equal {baz 5} [r exget exstringkey2]
+
+        assert_equal {SKIPPED 6} [r exsetvergt exstringkey x 11 exstringkey2 y 6]
+        assert_equal {bar 11} [r exget exstringkey]
+        assert_equal {y 6} [r exget exstringkey2]
+
+        catch {r exsetvergt exstringkey x} err
+        assert_match {*wrong number of arguments*} $err
+        catch {r exsetvergt exstringkey x abc} err
+        assert_match {*ERR version should be integer*} $err
+    }
+
+    test {exincrby reqid} {
+        r del exstringkey
+
+        assert_equal 10 [r exincrby exstringkey 10 REQID req1]
+        assert_equal 15 [r exincrby exstringkey 5 REQID req2]
+        # Retries get the original result back without applying the delta.
+        assert_equal 10 [r exincrby exstringkey 10 REQID req1]
+        assert_equal {15 2} [r exincrby exstringkey 5 REQID req2 WITHVERSION]
+        assert_equal {15 2} [r exget exstringkey]
+        # A retry with other arguments is refused.
+        catch {r exincrby exstringkey 3 REQID req1} err
+        assert_match {*ERR request id*} $err
+        catch {r exincrby exstringkey 10 RESERVE 1 REQID req1} err
+        assert_match {*ERR request id*} $err
+
+        assert_equal 16 [r exincrby exstringkey 1 REQID req3 DEDUPWINDOW 100]
+        after 200
+        assert_equal 17 [r exincrby exstringkey 1 REQID req3]
+
+        # The dedup state survives a reload and an AOF rewrite.
+        r debug reload
+        assert_equal 10 [r exincrby exstringkey 10 REQID req1]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal 15 [r exincrby exstringkey 5 REQID req2]
+        assert_equal {17 4} [r exget exstringkey]
+
+        # Only the last requests are remembered.
+        for {set j 0} {$j < 20} {incr j} {
+            r exincrby exstringkey 1 REQID ring$j
+        }
+        assert_equal 37 [r exincrby exstringkey 1 REQID ring19]
+        assert_equal 38 [r exincrby exstringkey 1 REQID ring0]
+
+        # Any other write resets the counter and forgets the requests.
+        r exset exstringkey 0
+        assert_equal 1 [r exincrby exstringkey 1 REQID ring0]
+
+        catch {r exincrby exstringkey 1 DEDUPWINDOW 100} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exincrby exstringkey 1 REQID a DEDUPWINDOW 0} err
+        assert_match {*ERR syntax error*} $err
+    }
+
+    test {exincrby reserve} {
+        r del exstringkey
+
+        assert_equal {1 1000} [r exincrby exstringkey 1000 RESERVE 1]
+        assert_equal {1001 2000 2001 3000} [r exincrby exstringkey 1000 RESERVE 2]
+        assert_equal {3001 3100 3} [r exincrby exstringkey 100 RESERVE 1 WITHVERSION]
+        assert_equal {3100 3} [r exget exstringkey]
+
+        # MIN/MAX and overflow apply to the whole reservation.
+        catch {r exincrby exstringkey 1000 RESERVE 2 MAX 5000} err
+        assert_match {*ERR increment or decrement would overflow*} $err
+        assert_equal {3101 4100} [r exincrby exstringkey 1000 RESERVE 1 MAX 5000]
+        catch {r exincrby exstringkey 9223372036854775807 RESERVE 2} err
+        assert_match {*ERR increment or decrement would overflow*} $err
+
+        # A retried reservation gets the same segments back.
+        assert_equal {4101 4110 4111 4120} [r exincrby exstringkey 10 RESERVE 2 REQID r1]
+        assert_equal {4101 4110 4111 4120} [r exincrby exstringkey 10 RESERVE 2 REQID r1]
+        catch {r exincrby exstringkey 10 RESERVE 3 REQID r1} err
+        assert_match {*ERR request id*} $err
+        catch {r exincrby exstringkey 20 RESERVE 2 REQID r1} err
+        assert_match {*ERR request id*} $err
+        r debug reload
+        assert_equal {4101 4110 4111 4120} [r exincrby exstringkey 10 RESERVE 2 REQID r1]
+        assert_equal {4120 5} [r exget exstringkey]
+
+        catch {r exincrby exstringkey 0 RESERVE 1} err
+        assert_match {*ERR reserve*} $err
+        catch {r exincrby exstringkey 10 RESERVE 0} err
+        assert_match {*ERR reserve*} $err
+        catch {r exincrby exstringkey 10 RESERVE 17} err
+        assert_match {*ERR reserve*} $err
+        catch {r exincrby exstringkey 10 RESERVE 1 NONEGATIVE} err
+        assert_match {*ERR reserve*} $err
+    }
+
+    test {exlock exrenew exunlock} {
+        r del exstringkey
+
+        assert_equal 1 [r exlock exstringkey c1 10000]
+        assert_equal {} [r exlock exstringkey c2 10000]
+        # Acquiring again as the owner extends the lock, same token.
+        assert_equal 1 [r exlock exstringkey c1 10000]
+        assert_equal {c1 1} [r exget exstringkey]
+
+        assert_equal 0 [r exrenew exstringkey c2 10000]
+        assert_equal 1 [r exrenew exstringkey c1 10000]
+        assert_equal 0 [r exunlock exstringkey c2]
+        assert_equal 1 [r exunlock exstringkey c1]
+        assert_equal 0 [r exunlock exstringkey c1]
+        assert_equal 0 [r exrenew exstringkey c1 10000]
+
+        # The key is kept so the token keeps increasing.
+        assert_equal 2 [r exlock exstringkey c2 100]
+        after 200
+        assert_equal 0 [r exrenew exstringkey c2 10000]
+        assert_equal 3 [r exlock exstringkey c1 10000]
+
+        r debug reload
+        assert_equal {} [r exlock exstringkey c2 10000]
+        assert_equal 1 [r exunlock exstringkey c1]
+        assert_equal 4 [r exlock exstringkey c2 10000]
+
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {} [r exlock exstringkey c1 10000]
+        assert_equal 1 [r exunlock exstringkey c2]
+
+        # A plain write turns the lock back into data, which EXLOCK refuses.
+        assert_equal 5 [r exlock exstringkey c1 10000]
+        r exset exstringkey data
+        assert_equal 0 [r exunlock exstringkey c1]
+        catch {r exlock exstringkey c1 10000} err
+        assert_match {*ERR key is not a lock*} $err
+        assert_equal {data 6} [r exget exstringkey]
+
+        catch {r exlock exstringkey c1 0} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exlock exstringkey c1 abc} err
+        assert_match {*ERR syntax error*} $err
+        r set strkey v
+        catch {r exlock strkey c1 1000} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {exsemacquire exsemrelease} {
+        r del exstringkey
+
+        assert_equal 1 [r exsemacquire exstringkey 2 h1 10000]
+        assert_equal 1 [r exsemacquire exstringkey 2 h2 100]
+        assert_equal 0 [r exsemacquire exstringkey 2 h3 10000]
+        # A holder acquiring again renews its permit.
+        assert_equal 1 [r exsemacquire exstringkey 2 h1 10000]
+        assert_equal {2 3} [r exget exstringkey]
+
+        # Expired permits are reclaimed by the next acquire.
+        after 200
+        assert_equal 0 [r exsemrelease exstringkey h2]
+        assert_equal 1 [r exsemacquire exstringkey 2 h3 10000]
+        assert_equal {2 4} [r exget exstringkey]
+
+        r debug reload
+        assert_equal 0 [r exsemacquire exstringkey 2 h4 10000]
+        assert_equal 1 [r exsemrelease exstringkey h1]
+        assert_equal 0 [r exsemrelease exstringkey h1]
+
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {1 5} [r exget exstringkey]
+        assert_equal 1 [r exsemacquire exstringkey 2 h4 10000]
+        assert_equal 0 [r exsemacquire exstringkey 2 h5 10000]
+
+        # A plain write drops the holders, so the rewrite keeps the value.
+        r exset exstringkey data
+        assert_equal 0 [r exsemrelease exstringkey h4]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {data 7} [r exget exstringkey]
+        catch {r exsemacquire exstringkey 2 h1 10000} err
+        assert_match {*not a semaphore*} $err
+        assert_equal {data 7} [r exget exstringkey]
+
+        # A semaphore with no holders left is still one.
+        r del exstringkey
+        assert_equal 1 [r exsemacquire exstringkey 1 h1 10000]
+        assert_equal 1 [r exsemrelease exstringkey h1]
+        r debug reload
+        assert_equal 1 [r exsemacquire exstringkey 1 h2 10000]
+        assert_equal 1 [r exsemrelease exstringkey h2]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {0 4} [r exget exstringkey]
+        assert_equal 1 [r exsemacquire exstringkey 1 h3 10000]
+
+        catch {r exsemacquire exstringkey 0 h1 10000} err
+        assert_match {*ERR limit*} $err
+        catch {r exsemacquire exstringkey 2 h1 0} err
+        assert_match {*ERR syntax error*} $err
+        r set strkey v
+        catch {r exsemacquire strkey 2 h1 1000} err
+        assert_match {*WRONGTYPE*} $err
+    }
+
+    test {exratelimit} {
+        r del exstringkey
+
+        assert_equal {1 2 -1} [r exratelimit exstringkey 10 3]
+        assert_equal {1 1 -1} [r exratelimit exstringkey 10 3]
+        assert_equal {1 0 -1} [r exratelimit exstringkey 10 3]
+        set res [r exratelimit exstringkey 10 3]
+        assert_equal 0 [lindex $res 0]
+        assert_equal 0 [lindex $res 1]
+        assert {[lindex $res 2] > 0 && [lindex $res 2] <= 100}
+
+        # The key expires once the whole burst is available again.
+        set pttl [r pttl exstringkey]
+        assert {$pttl > 0 && $pttl <= 300}
+        after 350
+        assert_equal 0 [r exists exstringkey]
+
+        # COST takes several cells at once, COST 0 only peeks.
+        assert_equal {1 3 -1} [r exratelimit exstringkey 10 3 COST 0]
+        assert_equal 0 [r exists exstringkey]
+        assert_equal {1 0 -1} [r exratelimit exstringkey 10 3 COST 3]
+        assert_equal 0 [lindex [r exratelimit exstringkey 10 3 COST 1] 0]
+
+        # The key stays a rate limiter across a reload and an AOF rewrite.
+        r del exstringkey
+        r exratelimit exstringkey 1 10
+        r debug reload
+        assert_equal 1 [lindex [r exratelimit exstringkey 1 10] 0]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal 1 [lindex [r exratelimit exstringkey 1 10] 0]
+
+        catch {r exratelimit exstringkey 0 3} err
+        assert_match {*ERR rate*} $err
+        catch {r exratelimit exstringkey 10 0} err
+        assert_match {*ERR rate*} $err
+        catch {r exratelimit exstringkey 10 3 COST -1} err
+        assert_match {*ERR syntax error*} $err
+        # Keys it did not create are refused, even integer ones.
+        r exset exstringkey 100
+        catch {r exratelimit exstringkey 10 3} err
+        assert_match {*ERR key is not a rate limiter*} $err
+        assert_equal {100} [lindex [r exget exstringkey] 0]
+    }
+
+    test {exwincrby exwcount} {
+        r del exstringkey
+
+        assert_equal 0 [r exwcount exstringkey]
+        assert_equal 3 [r exwincrby exstringkey 3 WINDOW 1s BUCKET 200ms]
+        assert_equal 5 [r exwincrby exstringkey 2 window 1000 bucket 200]
+        assert_equal 5 [r exwcount exstringkey]
+        assert_equal {5 2} [r exget exstringkey]
+
+        after 250
+        assert_equal 6 [r exwincrby exstringkey 1 WINDOW 1s BUCKET 200ms]
+        assert_equal 1 [r exwcount exstringkey RANGE 200ms]
+        assert_equal 6 [r exwcount exstringkey RANGE 1h]
+        set pttl [r pttl exstringkey]
+        assert {$pttl > 0 && $pttl <= 1000}
+
+        r debug reload
+        assert_equal 6 [r exwcount exstringkey]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal 6 [r exwcount exstringkey]
+        assert_equal 1 [r exwcount exstringkey RANGE 200ms]
+
+        # Old buckets leave the window.
+        after 1100
+        assert_equal 0 [r exwcount exstringkey]
+
+        r del exstringkey
+        r exwincrby exstringkey 1 WINDOW 1s BUCKET 200ms
+        catch {r exwincrby exstringkey 1 WINDOW 2s BUCKET 200ms} err
+        assert_match {*ERR window or bucket does not match*} $err
+        catch {r exwincrby exstringkey 1 WINDOW 1s BUCKET 300ms} err
+        assert_match {*ERR window should be*} $err
+        catch {r exwincrby exstringkey 1 WINDOW 1d BUCKET 1s} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exwincrby exstringkey 1 WINDOW 1h BUCKET 1ms} err
+        assert_match {*ERR window should be*} $err
+
+        # A plain write drops the buckets, also across an AOF rewrite.
+        r exset exstringkey bar
+        catch {r exwcount exstringkey} err
+        assert_match {*ERR key is not a windowed counter*} $err
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal bar [lindex [r exget exstringkey] 0]
+        catch {r exwcount exstringkey} err
+        assert_match {*ERR key is not a windowed counter*} $err
+    }
+
+    test {exincrbyfloat halflife} {
+        r del exstringkey
+
+        assert_equal 100 [r exincrbyfloat exstringkey 100 HALFLIFE 200]
+        after 200
+        set v [lindex [r exget exstringkey] 0]
+        assert {$v < 51 && $v > 40}
+        set v [r exincrbyfloat exstringkey 100 HALFLIFE 200]
+        assert {$v < 151 && $v > 140}
+
+        # The decay state survives a reload and an AOF rewrite.
+        r debug reload
+        set v [lindex [r exget exstringkey] 0]
+        assert {$v < 151 && $v > 50}
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        after 400
+        set v [lindex [r exget exstringkey] 0]
+        assert {$v < 40}
+
+        # Any other write makes it a plain value again.
+        r exset exstringkey 100
+        after 200
+        assert_equal {100 3} [r exget exstringkey]
+
+        catch {r exincrbyfloat exstringkey 1 HALFLIFE 0} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exincrbyfloat exstringkey 1 HALFLIFE abc} err
+        assert_match {*ERR syntax error*} $err
+    }
+
+    test {exvincrby exvadd exvget} {
+        r del exstringkey
+
+        assert_equal {} [r exvget exstringkey]
+        assert_equal {5 -2} [r exvincrby exstringkey 2 5 0 -2]
+        assert_equal {-2 0 5} [r exvget exstringkey]
+        assert_equal {7} [r exvincrby exstringkey 2 2]
+        assert_equal 4 [r exvadd exstringkey 1 1 1 1]
+        assert_equal {-1 1 8 1} [r exvget exstringkey]
+        assert_equal {8 1} [r exvget exstringkey 2 -1]
+        assert_equal {} [r exvget exstringkey 5 10]
+        assert_equal {{} 3} [r exget exstringkey]
+
+        # A failed command changes nothing.
+        catch {r exvincrby exstringkey 0 1 1 9223372036854775807 1 1} err
+        assert_match {*ERR increment or decrement would overflow*} $err
+        assert_equal {-1 1 8 1} [r exvget exstringkey]
+        catch {r exvadd exstringkey 1 9223372036854775807} err
+        assert_match {*ERR increment or decrement would overflow*} $err
+        assert_equal {-1 1 8 1} [r exvget exstringkey]
+
+        r del exstringkey
+        assert_equal {2147483647} [r exvincrby exstringkey TYPE int32 0 2147483647]
+        catch {r exvincrby exstringkey 0 1} err
+        assert_match {*ERR increment or decrement would overflow*} $err
+        catch {r exvincrby exstringkey TYPE int64 0 1} err
+        assert_match {*ERR type should be*} $err
+
+        r del exstringkey
+        assert_equal {0.5 0.25} [r exvincrby exstringkey TYPE float 0 0.5 1 0.25]
+        assert_equal 3 [r exvadd exstringkey 0.1 0.1 0.1]
+        assert_equal {0.6 0.35 0.1} [r exvget exstringkey]
+
+        r debug reload
+        assert_equal {0.6 0.35 0.1} [r exvget exstringkey]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {0.6 0.35 0.1} [r exvget exstringkey]
+        assert_equal {{} 2} [r exget exstringkey]
+
+        catch {r exvincrby exstringkey 65536 1} err
+        assert_match {*ERR index is out of range*} $err
+        catch {r exvincrby exstringkey TYPE double 0 1} err
+        assert_match {*ERR type should be*} $err
+
+        # A plain write drops the elements, also across an AOF rewrite.
+        r exset exstringkey 1
+        catch {r exvget exstringkey} err
+        assert_match {*ERR key is not a vector*} $err
+        assert_equal 2 [r exincrby exstringkey 1]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {2 4} [r exget exstringkey]
+        catch {r exvget exstringkey} err
+        assert_match {*ERR key is not a vector*} $err
+    }
+
+    test {exlease} {
+        r del exstringkey
+
+        set res [r exlease exstringkey 10000]
+        assert_equal [lindex $res 0] {}
+        set token [lindex $res 1]
+        assert {[r pttl exstringkey] > 0}
+        assert_equal {} [r exget exstringkey]
+        assert_equal {{}} [r exmeta exstringkey]
+        assert_equal [r exwait exstringkey 0 100] "TIMEOUT"
+
+        # Other callers wait for the holder to fill the key.
+        set rd [redis_deferring_client]
+        $rd exlease exstringkey 10000
+        wait_for_condition 50 100 {
+            [s blocked_clients] == 1
+        } else {
+            fail "exlease client not blocked"
+        }
+        assert_equal {} [r exset exstringkey bar LEASE [expr $token + 1]]
+        r debug reload
+        assert_equal {} [r exget exstringkey]
+        assert_equal OK [r exset exstringkey bar LEASE $token]
+        assert_equal [$rd read] "bar 1"
+        assert_equal -1 [r pttl exstringkey]
+        assert_equal {} [r exset exstringkey baz LEASE $token]
+        assert_equal {bar 1} [r exlease exstringkey 10000]
+        $rd close
+
+        # An expired lease can be taken over.
+        r del exstringkey
+        set token [lindex [r exlease exstringkey 100] 1]
+        after 200
+        set newtoken [lindex [r exlease exstringkey 10000] 1]
+        assert {$newtoken > $token}
+        assert_equal {} [r exset exstringkey bar LEASE $token]
+
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert {[r pttl exstringkey] > 0}
+        assert_equal OK [r exset exstringkey bar LEASE $newtoken]
+        assert_equal {bar 1} [r exget exstringkey]
+
+        # Counters count from 0 on a placeholder.
+        r del exstringkey
+        r exlease exstringkey 10000
+        assert_equal 5 [r exincrby exstringkey 5]
+        assert_equal {5 1} [r exget exstringkey]
+
+        catch {r exlease exstringkey 0} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exget exstringkey LEASE 10000} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar LEASE abc} err
+        assert_match {*ERR syntax error*} $err
+    }
+
+    test {exset softttl grace} {
+        r del exstringkey
+
+        assert_equal OK [r exset exstringkey bar SOFTTTL 100 GRACE 10000]
+        set pttl [r pttl exstringkey]
+        assert {$pttl > 9000 && $pttl <= 10100}
+        assert_equal {bar 1} [r exget exstringkey]
+        after 200
+
+        # Only the first stale reader is told to refresh.
+        assert_equal {bar 1 REFRESH} [r exget exstringkey]
+        assert_equal {bar 1 STALE} [r exget exstringkey]
+        assert_equal {bar 1 0 STALE} [r exget exstringkey WITHFLAGS]
+        assert_equal {bar 1 STALE} [r exget exstringkey IFNEWER 1]
+
+        r debug reload
+        assert_equal {bar 1 REFRESH} [r exget exstringkey]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {bar 1 REFRESH} [r exget exstringkey]
+        assert {[r pttl exstringkey] > 0}
+
+        # Any other write ends the stale period.
+        r exset exstringkey baz
+        assert_equal {baz 2} [r exget exstringkey]
+        assert_equal -1 [r pttl exstringkey]
+
+        r exset exstringkey bar SOFTTTL 100 GRACE 100
+        after 300
+        assert_equal 0 [r exists exstringkey]
+
+        catch {r exset exstringkey bar SOFTTTL 100} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar GRACE 100} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar SOFTTTL 100 GRACE 100 EX 10} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar SOFTTTL 0 GRACE 100} err
+        assert_match {*ERR syntax error*} $err
+    }
+
+    test {expire jitter and early refresh} {
+        r del exstringkey
+
+        for {set i 0} {$i < 20} {incr i} {
+            r exset exstringkey bar EX 100 JITTER 50
+            set ttl [r ttl exstringkey]
+            assert {$ttl >= 49 && $ttl <= 100}
+            r exincrby exstringkey 1 PX 100000 JITTER 10
+            set pttl [r pttl exstringkey]
+            assert {$pttl >= 89000 && $pttl <= 100000}
+        }
+        r exset exstringkey bar PX 100000 JITTER 0
+        assert {[r pttl exstringkey] > 99000}
+
+        catch {r exset exstringkey bar JITTER 10} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar EX 10 JITTER 101} err
+        assert_match {*ERR syntax error*} $err
+
+        # The cost of a recompute can never reach the expire, or always does.
+        r exset exstringkey bar PX 100000 RECOMPUTE 1
+        assert_equal {bar 1} [r exget exstringkey]
+        r exset exstringkey bar PX 100 RECOMPUTE 1000000000
+        assert_equal {bar 2 REFRESH} [r exget exstringkey]
+        assert_equal {bar 2 REFRESH} [r exget exstringkey IFNEWER 2]
+        r debug reload
+        assert_equal {bar 2 REFRESH} [r exget exstringkey]
+
+        # Without an expire there is nothing to refresh early.
+        r exset exstringkey bar RECOMPUTE 1000000000
+        assert_equal {bar 3} [r exget exstringkey]
+        r exset exstringkey bar PX 100000
+        assert_equal {bar 4} [r exget exstringkey]
+
+        catch {r exset exstringkey bar RECOMPUTE 0} err
+        assert_match {*ERR syntax error*} $err
+    }
+
+    test {exset exget namespace} {
+        r del exstringkey exstringkey2 {exstringkey}ns
+
+        assert_equal OK [r exset exstringkey bar NS {exstringkey}ns]
+        r exincrby {exstringkey}ns 5
+        assert_equal OK [r exset exstringkey2 baz NS {exstringkey}ns]
+        assert_equal {} [r exget exstringkey NS {exstringkey}ns]
+        # The read does not delete the stale entry.
+        assert_equal 1 [r exists exstringkey]
+        assert_equal {baz 1} [r exget exstringkey2 NS {exstringkey}ns]
+        # Reads without NS do not check the generation.
+        assert_equal {baz 1} [r exget exstringkey2]
+
+        r debug reload
+        assert_equal {baz 1} [r exget exstringkey2 NS {exstringkey}ns]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {baz 1} [r exget exstringkey2 NS {exstringkey}ns]
+
+        # Invalidate the whole namespace at once.
+        r exincrby {exstringkey}ns 1
+        assert_equal {} [r exget exstringkey2 NS {exstringkey}ns]
+        assert_equal 1 [r exists exstringkey2]
+        # EXLEASE, a write, replaces the stale entry with a placeholder.
+        assert_equal {} [lindex [r exlease exstringkey2 10000 NS {exstringkey}ns] 0]
+        assert_equal {} [r exget exstringkey2]
+        r del exstringkey2
+
+        # A later write without NS is not part of the namespace anymore.
+        r exset exstringkey bar NS {exstringkey}ns
+        r exset exstringkey bar
+        r exincrby {exstringkey}ns 1
+        assert_equal {bar 2} [r exget exstringkey NS {exstringkey}ns]
+
+        r exset {exstringkey}ns abc
+        catch {r exset exstringkey bar NS {exstringkey}ns} err
+        assert_match {*ERR namespace key is not an integer*} $err
+        catch {r exget exstringkey NS {exstringkey}ns} err
+        assert_match {*ERR namespace key is not an integer*} $err
+        r del {exstringkey}ns
+        r lpush {exstringkey}ns 1
+        catch {r exget exstringkey NS {exstringkey}ns} err
+        assert_match {*WRONGTYPE*} $err
+        r del {exstringkey}ns
+
+        # The namespace key is declared as a key of the command.
+        assert_equal {k nsk} [r command getkeys exset k v TAGS 1 ns NS nsk]
+        assert_equal {k nsk} [r command getkeys exget k WITHFLAGS NS nsk]
+        assert_equal {k nsk} [r command getkeys exlease k 100 NS nsk]
+        assert_equal {k} [r command getkeys exget k IFNEWER 1]
+    }
+
+    test {exset tags exinvalidate} {
+        r del exstringkey exstringkey2 exstringkey3 exstringkey4
+
+        assert_equal OK [r exset exstringkey bar TAGS 2 a b]
+        r exset exstringkey2 bar TAGS 1 a
+        r exset exstringkey3 bar TAGS 1 b
+        assert_equal 2 [r exinvalidate a]
+        wait_for_condition 50 100 {
+            [r exists exstringkey exstringkey2] == 0
+        } else {
+            fail "tagged keys not invalidated"
+        }
+        assert_equal 1 [r exists exstringkey3]
+        assert_equal 0 [r exinvalidate a]
+        assert_equal 1 [r exinvalidate b]
+
+        # A rewrite without TAGS, DEL and expire all drop the key from the index.
+        r exset exstringkey bar TAGS 1 c
+        r exset exstringkey baz
+        r exset exstringkey2 bar TAGS 1 c
+        r del exstringkey2
+        r exset exstringkey3 bar PX 50 TAGS 1 c
+        after 100
+        assert_equal 0 [r exists exstringkey3]
+        assert_equal 0 [r exinvalidate c]
+        assert_equal 1 [r exists exstringkey]
+
+        # RENAME is followed.
+        r exset exstringkey2 bar TAGS 1 d
+        r rename exstringkey2 exstringkey4
+        assert_equal 1 [r exinvalidate d]
+        wait_for_condition 50 100 {
+            [r exists exstringkey4] == 0
+        } else {
+            fail "renamed key not invalidated"
+        }
+
+        # A copy restored under another name keeps the source indexed.
+        r exset exstringkey2 bar TAGS 1 g
+        r restore exstringkey4 0 [r dump exstringkey2]
+        assert_equal 2 [r exinvalidate g]
+        wait_for_condition 50 100 {
+            [r exists exstringkey2 exstringkey4] == 0
+        } else {
+            fail "restored key or its source not invalidated"
+        }
+
+        # So does RESTORE ... REPLACE over the same name.
+        r exset exstringkey2 bar TAGS 1 h
+        r restore exstringkey2 0 [r dump exstringkey2] REPLACE
+        assert_equal 1 [r exinvalidate h]
+        wait_for_condition 50 100 {
+            [r exists exstringkey2] == 0
+        } else {
+            fail "replaced key not invalidated"
+        }
+
+        # A key written again before the timer runs is kept, even with the tag.
+        r exset exstringkey2 bar TAGS 1 i
+        r multi
+        r exinvalidate i
+        r exset exstringkey2 baz TAGS 1 i
+        r exec
+        after 100
+        assert_equal {baz 2} [r exget exstringkey2]
+        r del exstringkey2
+
+        r exset exstringkey bar TAGS 1 e
+        r debug reload
+        r exset exstringkey2 bar TAGS 1 f
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal 1 [r exinvalidate e]
+        assert_equal 1 [r exinvalidate f]
+        wait_for_condition 50 100 {
+            [r exists exstringkey exstringkey2] == 0
+        } else {
+            fail "tagged keys not invalidated after reload"
+        }
+
+        # Large tags are invalidated over several timer ticks.
+        for {set i 0} {$i < 5000} {incr i} {
+            r exset exstringkey:$i bar TAGS 1 big
+        }
+        assert_equal 5000 [r exinvalidate big]
+        wait_for_condition 50 100 {
+            [llength [r keys exstringkey:*]] == 0
+        } else {
+            fail "large tag not invalidated"
+        }
+
+        catch {r exset exstringkey bar TAGS 0} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar TAGS 2 a} err
+        assert_match {*ERR syntax error*} $err
+        catch {r exset exstringkey bar TAGS 33 a} err
+        assert_match {*ERR syntax error*} $err
+    }
+
+    test {exscan} {
+        r del exscankey1 exscankey2 exscankey3 exscankey4
+        r exset exscankey1 a
+        r exset exscankey2 bbbb ABS 5 FLAGS 6
+        r exset exscankey3 cccccc ABS 9 FLAGS 2 EX 100
+        r set exscankey4 dddddddd
+
+        proc exscan_all {args} {
+            set cursor 0
+            set res {}
+            while 1 {
+                set reply [r exscan $cursor MATCH exscankey* {*}$args]
+                set cursor [lindex $reply 0]
+                lappend res {*}[lindex $reply 1]
+                if {$cursor == 0} break
+            }
+            lsort -index 0 $res
+        }
+
+        set res [exscan_all]
+        assert_equal 3 [llength $res]
+        assert_equal {exscankey1 1 0 1 -1} [lindex $res 0]
+        assert_equal {exscankey2 5 6 4 -1} [lindex $res 1]
+        assert_equal exscankey3 [lindex $res 2 0]
+        set ttl [lindex $res 2 4]
+        assert {$ttl > 0 && $ttl <= 100000}
+
+        assert_equal {exscankey2 exscankey3} [lmap e [exscan_all MINVER 5] {lindex $e 0}]
+        assert_equal {exscankey2 exscankey3} [lmap e [exscan_all FLAGSMASK 2] {lindex $e 0}]
+        assert_equal {exscankey2} [lmap e [exscan_all FLAGSMASK 4] {lindex $e 0}]
+        assert_equal {exscankey3} [lmap e [exscan_all MINSIZE 5] {lindex $e 0}]
+        assert_equal {exscankey1 exscankey2} [lmap e [exscan_all NOTTL COUNT 1] {lindex $e 0}]
+        assert_equal {} [exscan_all MINVER 6 NOTTL]
+
+        catch {r exscan 0 COUNT 0} err
+        assert_match {*ERR*syntax*} $err
+        catch {r exscan 0 NOSUCHOPT} err
+        assert_match {*ERR*syntax*} $err
+        catch {r exscan notacursor} err
+        assert_match {*ERR*} $err
+        r del exscankey1 exscankey2 exscankey3 exscankey4
+    }
+
+    test {exset keepversions exget version} {
+        r del exstringkey
+
+        r exset exstringkey v1 KEEPVERSIONS 2
+        r exset exstringkey v2 FLAGS 7
+        r exset exstringkey v3
+        r exappend exstringkey x
+        assert_equal {v3x 4} [r exget exstringkey]
+        assert_equal {v3x 4} [r exget exstringkey VERSION 4]
+        assert_equal {v3 3} [r exget exstringkey VERSION 3]
+        assert_equal {v2 2 7} [r exget exstringkey VERSION 2 WITHFLAGS]
+        # Only the last 2 replaced versions are kept.
+        assert_equal {} [r exget exstringkey VERSION 1]
+        assert_equal {} [r exget exstringkey VERSION 5]
+
+        catch {r exget exstringkey VERSION 0} err
+        assert_match {*ERR*version*} $err
+        catch {r exget exstringkey VERSION 2 IFNEWER 1} err
+        assert_match {*ERR*syntax*} $err
+        catch {r exset exstringkey v KEEPVERSIONS 65} err
+        assert_match {*ERR*keepversions*} $err
+        catch {r exset exstringkey v KEEPFOR -1} err
+        assert_match {*ERR*keepversions*} $err
+
+        # The limits stick to the key and survive a reload and an AOF rewrite.
+        r exset exstringkey v5
+        assert_equal {v3x 4} [r exget exstringkey VERSION 4]
+        r debug reload
+        assert_equal {v3x 4} [r exget exstringkey VERSION 4]
+        r config set aof-use-rdb-preamble no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal {v3x 4} [r exget exstringkey VERSION 4]
+        assert_equal {v3 3} [r exget exstringkey VERSION 3]
+        r config set aof-use-rdb-preamble yes
+
+        # KEEPFOR drops versions replaced longer ago.
+        r exset exstringkey v6 KEEPVERSIONS 0 KEEPFOR 100
+        r exset exstringkey v7
+        assert_equal {v6 6} [r exget exstringkey VERSION 6]
+        after 200
+        assert_equal {} [r exget exstringkey VERSION 6]
+
+        # Both limits 0 turn it off.
+        r exset exstringkey v8 KEEPFOR 0
+        r exset exstringkey v9
+        assert_equal {} [r exget exstringkey VERSION 8]
+        r del exstringkey
+    }
+
+    test {internal state commands are refused from clients} {
+        r del exstringkey
+        r exset exstringkey 1
+
+        foreach cmd {
+            {exlockset exstringkey 0}
+            {exsemset exstringkey 1 holder 0}
+            {extagset exstringkey a}
+            {exvset exstringkey int64 1}
+            {exhistset exstringkey 1 0}
+        } {
+            catch {r {*}$cmd} err
+            assert_match {*only replicated or loaded from the AOF*} $err
+        }
+        assert_equal {1 1} [r exget exstringkey]
+        assert_equal 0 [r exinvalidate a]
+        r del exstringkey
+    }
+}
+
+start_server {tags {"ex_string_notify"}} {
+    r module load $testmodule notify-events yes
+
+    test {exstrtype writes publish op and version} {
+        r del exstringkey
+
+        set rd [redis_deferring_client]
+        $rd psubscribe __exstrtype@*__:*
+        $rd read
+
+        r exset exstringkey 10
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {exset 1}}
+
+        r exincrby exstringkey 5
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {exincrby 2}}
+
+        r exappend exstringkey 0
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {exappend 3}}
+
+        r exsetver exstringkey 10
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {exsetver 10}}
+
+        r excas exstringkey bar 10
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {excas 11}}
+
+        r exgae exstringkey EX 100
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {exgae 11}}
+
+        r excad exstringkey 11
+        assert_equal [$rd read] {pmessage __exstrtype@*__:* __exstrtype@9__:exstringkey {excad 11}}
+        $rd close
+    }
 }
 
+
+start_server {tags {"ex_string_changes"}} {
+    r module load $testmodule changelog-size 4
+
+    test {exchanges} {
+        r del exstringkey exstringkey2
+
+        catch {r exchanges 0 COUNT 0} err
+        assert_match {*ERR*syntax*error*} $err
+
+        set res [r exchanges 0]
+        assert_equal [lindex $res 0] "RESYNC"
+        set last [lindex $res 1]
+
+        r exset exstringkey bar
+        r exincrby exstringkey2 10
+        r exappend exstringkey foo
+
+        set res [r exchanges $last COUNT 2]
+        assert_equal [lindex $res 0] "OK"
+        assert_equal [lindex $res 1] [expr {$last + 2}]
+        assert_equal [lindex $res 2] [list [list [expr {$last + 1}] 9 exstringkey 1 exset] [list [expr {$last + 2}] 9 exstringkey2 1 exincrby]]
+
+        set res [r exchanges [expr {$last + 2}]]
+        assert_equal [lindex $res 1] [expr {$last + 3}]
+        assert_equal [lindex $res 2] [list [list [expr {$last + 3}] 9 exstringkey 2 exappend]]
+
+        set res [r exchanges [expr {$last + 3}]]
+        assert_equal $res [list OK [expr {$last + 3}] {}]
+
+        r exset exstringkey bar1
+        r exset exstringkey bar2
+        r excad exstringkey 4
+
+        set res [r exchanges $last]
+        assert_equal [lindex $res 0] "RESYNC"
+        assert_equal [lindex $res 1] [expr {$last + 6}]
+
+        set res [r exchanges [expr {$last + 2}]]
+        assert_equal [lindex $res 0] "OK"
+        assert_equal [llength [lindex $res 2]] 4
+        assert_equal [lindex $res 2 3] [list [expr {$last + 6}] 9 exstringkey 4 excad]
+    }
+}
 start_server {tags {"ex_string_repl"}} {
     r module load $testmodule
     r set myexkey foo
@@ -1467,5 +2742,246 @@ start_server {tags {"exhash repl"} overrides {bind 0.0.0.0}} {
             set res [$slave exget exstringkey]
             assert_equal $res ""
         }
+
+        test {cas keepttl master-slave} {
+            $master del exstringkey
+
+            $master set exstringkey bar1 EX 100
+            set res [$master cas exstringkey bar1 bar2 KEEPTTL]
+            assert_equal $res 1
+
+            $master WAIT 1 5000
+
+            assert_equal [$slave get exstringkey] "bar2"
+            set sttl [$slave ttl exstringkey]
+            assert {$sttl > 0 && $sttl <= 100}
+
+            set res [$master cas exstringkey bar2 bar3 PX 100000]
+            assert_equal $res 1
+
+            $master WAIT 1 5000
+
+            assert_equal [$slave get exstringkey] "bar3"
+            assert {[$slave pttl exstringkey] > 0}
+        }
+
+        test {exapply master-slave} {
+            $master del exstringkey
+
+            $master exset exstringkey 10 EX 100
+            assert_equal {15 2} [$master exapply exstringkey {val $1 add} 5]
+
+            $master WAIT 1 5000
+
+            assert_equal {15 2} [$slave exget exstringkey]
+            set sttl [$slave ttl exstringkey]
+            assert {$sttl > 0 && $sttl <= 100}
+        }
+
+        test {exincrby reqid master-slave} {
+            $master del exstringkey
+
+            assert_equal 10 [$master exincrby exstringkey 10 REQID req1]
+
+            $master WAIT 1 5000
+
+            # A promoted replica must keep deduplicating the same requests.
+            $slave config set slave-read-only no
+            assert_equal 10 [$slave exincrby exstringkey 10 REQID req1]
+            assert_equal {10 1} [$slave exget exstringkey]
+            $slave config set slave-read-only yes
+        }
+
+        test {exlock master-slave} {
+            $master del exstringkey
+
+            assert_equal 1 [$master exlock exstringkey c1 10000]
+            assert_equal 1 [$master exunlock exstringkey c1]
+            assert_equal 2 [$master exlock exstringkey c2 10000]
+
+            $master WAIT 1 5000
+
+            # A promoted replica keeps both the holder and the token.
+            $slave config set slave-read-only no
+            assert_equal {} [$slave exlock exstringkey c1 10000]
+            assert_equal 1 [$slave exunlock exstringkey c2]
+            assert_equal 3 [$slave exlock exstringkey c1 10000]
+            $slave config set slave-read-only yes
+        }
+
+        test {exsemacquire master-slave} {
+            $master del exstringkey
+
+            assert_equal 1 [$master exsemacquire exstringkey 2 h1 10000]
+            assert_equal 1 [$master exsemacquire exstringkey 2 h2 10000]
+            assert_equal 1 [$master exsemrelease exstringkey h1]
+
+            $master WAIT 1 5000
+            assert_equal {1 3} [$slave exget exstringkey]
+
+            $slave config set slave-read-only no
+            assert_equal 0 [$slave exsemrelease exstringkey h1]
+            assert_equal 1 [$slave exsemacquire exstringkey 2 h3 10000]
+            assert_equal 0 [$slave exsemacquire exstringkey 2 h4 10000]
+            $slave config set slave-read-only yes
+        }
+
+        test {exratelimit master-slave} {
+            $master del exstringkey
+
+            assert_equal {1 1 -1} [$master exratelimit exstringkey 1 2]
+            assert_equal {1 0 -1} [$master exratelimit exstringkey 1 2]
+
+            $master WAIT 1 5000
+            assert_equal [$master exget exstringkey] [$slave exget exstringkey]
+            set sttl [$slave pttl exstringkey]
+            assert {$sttl > 0 && $sttl <= 2000}
+        }
+
+        test {exwincrby master-slave} {
+            $master del exstringkey
+
+            $master exwincrby exstringkey 3 WINDOW 1m BUCKET 1s
+            assert_equal 5 [$master exwincrby exstringkey 2 WINDOW 1m BUCKET 1s]
+
+            $master WAIT 1 5000
+            assert_equal 5 [$slave exwcount exstringkey]
+            assert_equal [$master exget exstringkey] [$slave exget exstringkey]
+            set sttl [$slave pttl exstringkey]
+            assert {$sttl > 0 && $sttl <= 61000}
+        }
+
+        test {exincrbyfloat halflife master-slave} {
+            $master del exstringkey
+
+            $master exincrbyfloat exstringkey 100 HALFLIFE 3600000
+
+            $master WAIT 1 5000
+            after 100
+            set v [lindex [$slave exget exstringkey] 0]
+            assert {$v < 100 && $v > 99}
+        }
+
+        test {exvincrby master-slave} {
+            $master del exstringkey
+
+            $master exvincrby exstringkey TYPE int32 3 1
+            $master exvadd exstringkey 1 2 3
+            $master exvincrby exstringkey 0 10 0 5
+
+            $master WAIT 1 5000
+            assert_equal {16 2 3 1} [$slave exvget exstringkey]
+            assert_equal [$master exget exstringkey] [$slave exget exstringkey]
+        }
+
+        test {exlease master-slave} {
+            $master del exstringkey
+
+            set token [lindex [$master exlease exstringkey 10000] 1]
+            $master WAIT 1 5000
+            assert_equal {} [$slave exget exstringkey]
+            assert {[$slave pttl exstringkey] > 0}
+            catch {$slave exlease exstringkey 10000} err
+            assert_match {*READONLY*} $err
+
+            $master exset exstringkey bar LEASE $token
+            $master WAIT 1 5000
+            assert_equal {bar 1} [$slave exget exstringkey]
+            assert_equal -1 [$slave pttl exstringkey]
+        }
+
+        test {exset softttl master-slave} {
+            $master del exstringkey
+
+            $master exset exstringkey bar SOFTTTL 100 GRACE 10000
+            $master WAIT 1 5000
+            assert_equal {bar 1} [$slave exget exstringkey]
+            assert {[$slave pttl exstringkey] > 9000}
+            after 200
+            assert_equal {bar 1 REFRESH} [$slave exget exstringkey]
+            assert_equal {bar 1 REFRESH} [$master exget exstringkey]
+        }
+
+        test {exset jitter recompute master-slave} {
+            $master del exstringkey
+
+            $master exset exstringkey bar EX 1000 JITTER 50 RECOMPUTE 1000000000000
+            $master WAIT 1 5000
+            assert {abs([$master pttl exstringkey] - [$slave pttl exstringkey]) < 1000}
+            assert_equal {bar 1 REFRESH} [$slave exget exstringkey]
+        }
+
+        test {exset namespace master-slave} {
+            $master del exstringkey {exstringkey}ns
+
+            $master exset exstringkey bar NS {exstringkey}ns
+            $master exincrby {exstringkey}ns 1
+            $master WAIT 1 5000
+            assert_equal {} [$slave exget exstringkey NS {exstringkey}ns]
+            assert_equal 1 [$slave exists exstringkey]
+            assert_equal {} [$master exget exstringkey NS {exstringkey}ns]
+            $master WAIT 1 5000
+            # Neither side deletes the stale entry on a read.
+            assert_equal 1 [$master exists exstringkey]
+            assert_equal 1 [$slave exists exstringkey]
+        }
+
+        test {exset tags master-slave} {
+            $master del exstringkey exstringkey2
+
+            $master exset exstringkey bar TAGS 1 a
+            $master exset exstringkey2 bar TAGS 1 b
+            assert_equal 1 [$master exinvalidate a]
+            wait_for_condition 50 100 {
+                [$slave exists exstringkey] == 0
+            } else {
+                fail "invalidated key not deleted on the slave"
+            }
+            assert_equal 1 [$slave exists exstringkey2]
+        }
+
+        test {exincrby keeps tags on the slave} {
+            $master del exstringkey
+
+            $master exset exstringkey 1 TAGS 1 t
+            $master exincrby exstringkey 1
+            $master WAIT 1 5000
+            assert_equal {2 2} [$slave exget exstringkey]
+
+            $slave slaveof no one
+            assert_equal 1 [$slave exinvalidate t]
+            wait_for_condition 50 100 {
+                [$slave exists exstringkey] == 0
+            } else {
+                fail "tags lost on the slave"
+            }
+
+            $slave slaveof $master_host $master_port
+            wait_for_condition 50 100 {
+                [string match {*master_link_status:up*} [$slave info replication]]
+            } else {
+                fail "Can't turn the instance into a replica"
+            }
+        }
+
+        test {exset keepversions master-slave} {
+            $master del exstringkey
+
+            $master exset exstringkey 1 KEEPVERSIONS 4
+            $master exincrby exstringkey 1
+            $master exset exstringkey 10
+            $master exincrby exstringkey 5
+            $master exappend exstringkey x
+            wait_for_condition 50 100 {
+                [$slave exget exstringkey] eq {15x 5}
+            } else {
+                fail "history writes not replicated"
+            }
+            for {set v 1} {$v <= 5} {incr v} {
+                assert_equal [$master exget exstringkey VERSION $v] [$slave exget exstringkey VERSION $v]
+            }
+            assert_equal {15 4} [$slave exget exstringkey VERSION 4]
+            assert_equal {1 1} [$slave exget exstringkey VERSION 1]
+        }
  }
 }